@@ -0,0 +1,30 @@
+#include "mbed.h"
+
+#include <cstdio>
+
+#include "adcScan.h"
+
+
+AdcScan* adcScan = NULL;
+
+
+AdcScan::AdcScan() :
+    channels(0)
+{
+}
+
+
+int8_t AdcScan::addChannel(Pin* pin)
+{
+    if (this->channels == ADC_SCAN_CHANNELS) return -1;
+
+    this->input[this->channels] = new AnalogIn(pin->pinToPinName());
+
+    return this->channels++;
+}
+
+
+uint16_t AdcScan::read(uint8_t place)
+{
+    return this->input[place]->read_u16();
+}
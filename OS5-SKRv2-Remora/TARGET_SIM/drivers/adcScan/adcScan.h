@@ -0,0 +1,35 @@
+#ifndef ADCSCAN_H
+#define ADCSCAN_H
+
+#include "mbed.h"
+
+#include <cstdint>
+
+#include "drivers/pin/pin.h"
+
+#define ADC_SCAN_CHANNELS   8       // analog pins in the scan
+
+// Host simulation stand-in for AdcScan
+//
+// The simulated analog inputs hold the value set by simSetAnalog(), so a read is of that value
+// and there is no scan or averaging to play.
+
+class AdcScan
+{
+    private:
+
+        uint8_t             channels;
+        AnalogIn*           input[ADC_SCAN_CHANNELS];
+
+    public:
+
+        AdcScan(void);
+
+        int8_t addChannel(Pin*);            // returns the channel's place in the scan, -1 if it can't be scanned
+        uint16_t read(uint8_t);             // the 16 bit reading
+        void service(void) {}               // no scan to overrun
+};
+
+extern AdcScan* adcScan;
+
+#endif
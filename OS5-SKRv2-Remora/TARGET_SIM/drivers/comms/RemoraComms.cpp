@@ -0,0 +1,191 @@
+#include "mbed.h"
+#include "RemoraComms.h"
+#include "pruThread.h"
+
+
+RemoraComms::RemoraComms(volatile rxData_t* ptrRxData, volatile txData_t* ptrTxData, SPI_TypeDef* spiType, PinName interruptPin) :
+    spiType(spiType),
+    ptrRxData(ptrRxData),
+    ptrTxData(ptrTxData),
+    rxIndex(0),
+    commandFrame(NULL),
+    joints(JOINTS),
+    variables(VARIABLES),
+    sequence(0),
+    rejectCnt(0),
+    SPIdata(false),
+    SPIdataError(false),
+    phaseLock(NULL)
+{
+}
+
+
+void RemoraComms::init()
+{
+    printf("Initialising simulated SPI slave\n");
+}
+
+void RemoraComms::start()
+{
+    this->ptrTxData->header = PRU_DATA;
+    this->latchFeedback();
+}
+
+void RemoraComms::setLayout(uint8_t joints, uint8_t variables)
+{
+    this->joints = joints;
+    this->variables = variables;
+    printf("SPI frame: %d joints, %d variables, %d bytes\n", joints, variables, FRAME_SIZE(joints, variables));
+}
+
+
+void RemoraComms::transfer(const uint8_t* mosi, uint8_t* miso, int length)
+{
+    int frameSize = FRAME_SIZE(this->joints, this->variables);
+
+    // bytes beyond the armed frame are dropped, and clock out as 0
+    for (int i = 0; i < length; i++)
+    {
+        if (i < frameSize)
+        {
+            miso[i] = ((uint8_t*)this->txFrame)[i];
+            ((uint8_t*)this->rxFrame[this->rxIndex])[i] = mosi[i];
+        }
+        else
+        {
+            miso[i] = 0;
+        }
+    }
+
+    // chip select rising edge
+    this->processPacket();
+}
+
+
+void RemoraComms::processPacket()
+{
+    const uint32_t* frame = this->rxFrame[this->rxIndex];
+    uint32_t now = us_ticker_read();            // arrival time of the frame, for FrameTiming
+    uint32_t phase = this->phaseLock ? this->phaseLock->capture() : 0;
+
+    // as the STM32: withdraw an unlatched command, latch the feedback and swap the rx frames
+    this->commandFrame = NULL;
+    this->rxIndex ^= 1;
+    this->latchFeedback();
+
+    switch (((const frameHeader_t*)frame)->header)
+    {
+      case PRU_READ:
+        this->timing.frame(now, (const frameHeader_t*)frame, true);
+        this->SPIdata = true;
+        this->rejectCnt = 0;
+        // READ so do nothing with the received data
+        break;
+
+      case PRU_WRITE:
+        // a WRITE is only handed to the threads with the right version, layout and CRC. The
+        // feedback goes out in the same frame, so the host's exchange function needs only one transfer
+        if (checkCommand(frame, this->joints, this->variables))
+        {
+            this->timing.frame(now, (const frameHeader_t*)frame, true);
+            if (this->phaseLock) this->phaseLock->frame(phase);
+            this->commandFrame = frame;
+            this->SPIdata = true;
+            this->rejectCnt = 0;
+        }
+        else
+        {
+            this->timing.frame(now, (const frameHeader_t*)frame, false);
+            this->rejectPacket();
+        }
+        break;
+
+      default:
+        this->timing.frame(now, (const frameHeader_t*)frame, false);
+        this->rejectPacket();
+    }
+}
+
+void RemoraComms::setPhaseLock(PhaseLock* phaseLock)
+{
+    this->phaseLock = phaseLock;
+}
+
+bool RemoraComms::latchCommand()
+{
+    const uint32_t* frame = this->commandFrame;
+
+    if (frame == NULL) return false;
+
+    this->commandFrame = NULL;
+    unpackCommand(frame, this->ptrRxData, this->joints, this->variables);
+
+    return true;
+}
+
+void RemoraComms::latchFeedback()
+{
+    uint32_t generation;
+    uint32_t timing = this->timing.nextSlot();
+
+    // the threads preempt this interrupt and write txData, so pack it again if any thread ticked
+    // part way through. The frame then holds the feedback of one moment between two ticks
+    do
+    {
+        generation = pruThread::getGeneration();
+        packFeedback(this->txFrame, this->ptrTxData, this->sequence, this->joints, this->variables,
+                     this->timing.getTimestamp(), timing);
+    } while (generation != pruThread::getGeneration());
+
+    this->sequence++;
+}
+
+void RemoraComms::rejectPacket()
+{
+    this->rejectCnt++;
+    if (this->rejectCnt > 5)
+    {
+        this->SPIdataError = true;
+    }
+}
+
+
+bool RemoraComms::getStatus(void)
+{
+    return this->SPIdata;
+}
+
+void RemoraComms::setStatus(bool status)
+{
+    this->SPIdata = status;
+}
+
+bool RemoraComms::getError(void)
+{
+    return this->SPIdataError;
+}
+
+void RemoraComms::setError(bool error)
+{
+    this->SPIdataError = error;
+}
+
+
+// the STM32 CRC unit: CRC-32 polynomial 0x04C11DB7, initial value 0xFFFFFFFF, a word at a
+// time MSB first, no reflection and no final XOR
+uint32_t frameCRC(const uint32_t* data, uint32_t words)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (words--)
+    {
+        crc ^= *data++;
+
+        for (int bit = 0; bit < 32; bit++)
+        {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
+        }
+    }
+
+    return crc;
+}
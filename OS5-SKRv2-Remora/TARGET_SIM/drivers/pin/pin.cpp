@@ -0,0 +1,108 @@
+#include "mbed.h"
+
+#include "pin.h"
+#include <cstdio>
+#include <string>
+
+#include "stm32f4xx_hal.h"
+
+Pin::Pin(std::string portAndPin, int dir) :
+    portAndPin(portAndPin),
+    dir(dir),
+    modifier(NONE)
+{
+    this->configPin();
+}
+
+Pin::Pin(std::string portAndPin, int dir, int modifier) :
+    portAndPin(portAndPin),
+    dir(dir),
+    modifier(modifier)
+{
+    this->configPin();
+}
+
+void Pin::configPin()
+{
+    // default to a harmless pin so a bad definition cannot crash the simulation
+    this->portIndex = 0;
+    this->pinNumber = 0;
+    this->pin = 0;
+    this->GPIOx = GPIOA;
+
+    if (this->portAndPin[0] == 'P') // PXXX e.g.PA2 PC15
+    {
+        this->portIndex     = this->portAndPin[1] - 'A';
+        this->pinNumber     = this->portAndPin[3] - '0';
+        uint16_t pin2       = this->portAndPin[4] - '0';
+
+        if (pin2 <= 9)
+        {
+            this->pinNumber = this->pinNumber * 10 + pin2;
+        }
+
+        this->pin = 1 << this->pinNumber; // this is equivalent to GPIO_PIN_x definition
+    }
+    else
+    {
+        printf("  Invalid port and pin definition\n");
+        return;
+    }
+
+    if (this->portIndex >= SIM_GPIO_PORTS)
+    {
+        printf("  Invalid port and pin definition\n");
+        this->pin = 0;
+        return;
+    }
+
+    this->GPIOx = &simGPIO[this->portIndex];
+
+    this->initPin();
+}
+
+
+void Pin::initPin()
+{
+    // outputs start low, inputs are left to the simulator
+    if (this->dir == OUTPUT)
+    {
+        HAL_GPIO_WritePin(this->GPIOx, this->pin, GPIO_PIN_RESET);
+    }
+}
+
+void Pin::setAsOutput()
+{
+    this->dir = OUTPUT;
+    this->initPin();
+}
+
+
+void Pin::setAsInput()
+{
+    this->dir = INPUT;
+}
+
+
+void Pin::pull_none()
+{
+    this->modifier = PULLNONE;
+}
+
+
+void Pin::pull_up()
+{
+    this->modifier = PULLUP;
+}
+
+
+void Pin::pull_down()
+{
+    this->modifier = PULLDOWN;
+}
+
+
+PinName Pin::pinToPinName()
+{
+    return static_cast<PinName>((this->portIndex << 4) | this->pinNumber);
+}
@@ -0,0 +1,98 @@
+#include "mbed.h"
+#include "stm32f4xx_hal.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "stepDMA.h"
+#include "pruThread.h"
+#include "modules/module.h"
+#include "modules/stepgenDMA/stepgenDMA.h"
+
+
+// plays one word of each stream per simulated DMA request
+class StepDMATransfer : public Module
+{
+    private:
+
+        StepDMA* dma;
+
+    public:
+
+        StepDMATransfer(StepDMA* dma) : dma(dma) {}
+
+        virtual void update(void)
+        {
+            this->dma->transferWord();
+        }
+};
+
+
+StepDMA::StepDMA(uint32_t frequency, uint32_t blockSize, StepgenDMA* owner) :
+    owner(owner),
+    frequency(frequency),
+    blockSize(blockSize),
+    streams(0),
+    position(0)
+{
+    this->dmaThread = new pruThread(TIM8, TIM8_CC_IRQn, this->frequency);
+    this->transfer = new StepDMATransfer(this);
+    this->dmaThread->registerModule(this->transfer);
+}
+
+
+int8_t StepDMA::addPort(GPIO_TypeDef* port)
+{
+    for (uint8_t i = 0; i < this->streams; i++)
+    {
+        if (this->port[i] == port) return i;
+    }
+
+    if (this->streams == DMA_STREAMS) return -1;
+
+    this->port[this->streams] = port;
+    this->buffer[this->streams] = new uint32_t[2 * this->blockSize];
+    memset(this->buffer[this->streams], 0, 2 * this->blockSize * sizeof(uint32_t));
+
+    return this->streams++;
+}
+
+
+void StepDMA::start()
+{
+    printf("Starting step DMA at %d Hz, %d streams\n", this->frequency, this->streams);
+
+    this->owner->fillBlock(0);
+    this->owner->fillBlock(1);
+
+    this->position = 0;
+    this->dmaThread->startThread();
+}
+
+
+void StepDMA::stop()
+{
+    this->dmaThread->stopThread();
+}
+
+
+void StepDMA::transferWord()
+{
+    for (uint8_t i = 0; i < this->streams; i++)
+    {
+        this->port[i]->BSRR = this->buffer[i][this->position];
+    }
+
+    this->position++;
+
+    // half and full transfer interrupts
+    if (this->position == this->blockSize)
+    {
+        this->owner->fillBlock(0);
+    }
+    else if (this->position == 2 * this->blockSize)
+    {
+        this->position = 0;
+        this->owner->fillBlock(1);
+    }
+}
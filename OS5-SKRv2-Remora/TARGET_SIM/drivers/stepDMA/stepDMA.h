@@ -0,0 +1,57 @@
+#ifndef STEPDMA_H
+#define STEPDMA_H
+
+#include "mbed.h"
+#include "stm32f4xx_hal.h"
+
+#include <cstdint>
+
+#define DMA_STREAMS     3           // TIM8 CH1, CH3 and CH4 DMA requests, one GPIO port each
+
+class StepgenDMA;                   // forward declaration
+class pruThread;                    // forward declaration
+class StepDMATransfer;              // forward declaration
+
+// Host simulation stand-in for StepDMA
+//
+// The DMA is played by a simulated thread running at the DMA frequency. Each tick it writes the
+// next word of every buffer to its port's BSRR, and asks the owner to refill a block when the
+// transfer passes the half and the end of the buffers, as the DMA interrupts would.
+
+class StepDMA
+{
+    friend class StepDMATransfer;
+
+    private:
+
+        StepgenDMA*         owner;
+        uint32_t            frequency;
+        uint32_t            blockSize;          // words per block, the buffers are two blocks long
+        uint8_t             streams;            // number of streams in use
+        uint32_t            position;           // next word to transfer
+
+        GPIO_TypeDef*       port[DMA_STREAMS];
+        uint32_t*           buffer[DMA_STREAMS];
+
+        pruThread*          dmaThread;
+        StepDMATransfer*    transfer;
+
+        void transferWord(void);
+
+    public:
+
+        StepDMA(uint32_t frequency, uint32_t blockSize, StepgenDMA* owner);
+
+        static bool claim(void) { return true; }    // the simulated DMA has no timer to claim
+
+        int8_t addPort(GPIO_TypeDef*);          // returns the stream for the port, -1 if all are in use
+        uint32_t* getBuffer(uint8_t stream) { return this->buffer[stream]; }
+        uint8_t getStreams(void) { return this->streams; }
+        uint32_t getBlockSize(void) { return this->blockSize; }
+        uint32_t getFrequency(void) { return this->frequency; }
+
+        void start(void);
+        void stop(void);
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef MBED_SIM_H
+#define MBED_SIM_H
+
+// Host simulation stand-in for the parts of mbed OS used by the Remora modules
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+
+#include "stm32f4xx_hal.h"
+
+typedef enum
+{
+    NC = (int)0xFFFFFFFF
+} PinName;
+
+
+// Analog input backed by the simulator, see simSetAnalog()
+class AnalogIn
+{
+    private:
+
+        PinName     pin;
+
+    public:
+
+        AnalogIn(PinName pin) : pin(pin) {}
+        uint16_t read_u16(void);
+        float read(void) { return this->read_u16() / 65535.0F; }
+};
+
+
+inline void wait(float) {}
+inline void wait_us(int) {}
+
+uint32_t us_ticker_read(void);                  // simulated time in us, see simulator.cpp
+
+#endif
@@ -0,0 +1,389 @@
+#include "mbed.h"
+
+#include <chrono>
+#include <map>
+#include <string>
+
+#include "configuration.h"
+#include "remora.h"
+
+#include "RemoraComms.h"
+#include "commandLatch.h"
+#include "phaseLock.h"
+#include "pruThread.h"
+#include "timer.h"
+
+#include "modules/loadModules.h"
+#include "modules/stepgenDMA/stepgenDMA.h"
+#include "simulator.h"
+
+
+/***********************************************************************
+        STRUCTURES AND GLOBAL VARIABLES - as defined in main.cpp
+************************************************************************/
+
+volatile bool PRUreset;
+volatile bool commandTimeout;
+volatile uint32_t commandTicks;
+volatile uint32_t commandInterval;
+
+// unions for RX and TX data
+volatile rxData_t rxData;
+volatile txData_t txData;
+
+// pointers to objects with global scope
+pruThread* baseThread;
+pruThread* servoThread;
+pruThread* commsThread;
+PhaseLock* phaseLock;
+
+// pointers to data
+volatile rxData_t*  ptrRxData = &rxData;
+volatile txData_t*  ptrTxData = &txData;
+volatile int32_t*   ptrTxHeader;
+volatile bool*      ptrPRUreset;
+volatile int32_t*   ptrJointFreqCmd[JOINTS];
+volatile int32_t*   ptrJointFeedback[JOINTS];
+volatile uint8_t*   ptrJointEnable;
+volatile float*     ptrSetPoint[VARIABLES];
+volatile float*     ptrProcessVariable[VARIABLES];
+volatile uint8_t*   ptrInputs;
+volatile uint8_t*   ptrOutputs;
+
+// Remora communication protocol
+RemoraComms comms(ptrRxData, ptrTxData, SPI1, NC);
+
+
+/***********************************************************************
+        SIMULATED PERIPHERALS
+************************************************************************/
+
+uint32_t SystemCoreClock = 168000000;
+
+DWT_Type simDWT;
+CoreDebug_Type simCoreDebug;
+
+static uint32_t hostCycles(void)
+{
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    return (uint32_t)((ns * (SystemCoreClock / 1000000)) / 1000);
+}
+
+simCycleCounter::operator uint32_t() const
+{
+    return hostCycles() - this->offset;
+}
+
+simCycleCounter& simCycleCounter::operator=(uint32_t value)
+{
+    this->offset = hostCycles() - value;
+    return *this;
+}
+
+// the mbed microsecond ticker, free running like the STM32 TIM5 behind it
+uint32_t us_ticker_read(void)
+{
+    return (uint32_t)(simTimeNs() / 1000);
+}
+
+GPIO_TypeDef simGPIO[SIM_GPIO_PORTS];
+TIM_TypeDef simTIM8, simTIM9, simTIM10, simTIM11;
+SPI_TypeDef simSPI1;
+
+static std::map<int, uint16_t> simAnalog;
+
+uint16_t AnalogIn::read_u16(void)
+{
+    std::map<int, uint16_t>::iterator it = simAnalog.find(this->pin);
+
+    // mid scale unless the harness has set a value
+    return (it != simAnalog.end()) ? it->second : 0x8000;
+}
+
+
+/***********************************************************************
+        SIMULATED TIME
+************************************************************************/
+
+typedef struct
+{
+    uint64_t counts;            // timer counts at the last update
+    uint32_t period;            // counts to the next update, ARR + 1 as loaded at the last update
+    simThreadStats_t stats;
+} simTimerState_t;
+
+static std::map<pruTimer*, simTimerState_t> timerState;
+static uint64_t simTime;        // ns
+static double nsPerCount;       // timer clock, see simSetClockError()
+
+
+static double countsAt(uint64_t ns)
+{
+    return ns / nsPerCount;
+}
+
+static uint64_t deadline(pruTimer* timer, const simTimerState_t& state)
+{
+    return (uint64_t)llround((state.counts + state.period) * nsPerCount);
+}
+
+static simTimerState_t& stateOf(pruTimer* timer)
+{
+    std::map<pruTimer*, simTimerState_t>::iterator it = timerState.find(timer);
+
+    if (it == timerState.end())
+    {
+        simTimerState_t state = {};
+
+        // a timer started part way through the simulation begins counting from now
+        state.counts = (uint64_t)countsAt(simTime);
+        state.period = timer->getTimer()->ARR + 1;
+        state.stats.frequency = timer->getFrequency();
+        state.stats.minNs = UINT64_MAX;
+        it = timerState.insert(std::make_pair(timer, state)).first;
+    }
+
+    return it->second;
+}
+
+
+/***********************************************************************
+        ROUTINES
+************************************************************************/
+
+void simSetup()
+{
+    printf("\nSimulated Remora PRU - Programmable Realtime Unit\n");
+
+    simTime = 0;
+    timerState.clear();
+    simSetClockError(0);
+
+    comms.init();
+
+    baseThread = new pruThread(TIM9, TIM1_BRK_TIM9_IRQn, PRU_BASEFREQ);
+    servoThread = new pruThread(TIM10, TIM1_UP_TIM10_IRQn, PRU_SERVOFREQ);
+    commsThread = new pruThread(TIM11, TIM1_TRG_COM_TIM11_IRQn, PRU_COMMSFREQ);
+
+    baseThread->scheduleModule(new CommandLatch(comms, servoThread));
+
+    #if PHASE_LOCK
+    phaseLock = new PhaseLock(TIM9);
+    baseThread->scheduleModule(phaseLock);
+    comms.setPhaseLock(phaseLock);
+    #endif
+}
+
+
+bool simLoadModules(const char* json)
+{
+    uint8_t joints, variables;
+
+    if (!loadModules(json)) return false;
+
+    getFrameLayout(joints, variables);
+    comms.setLayout(joints, variables);
+    comms.start();
+    return true;
+}
+
+
+void simStartThreads()
+{
+    baseThread->startThread();
+    servoThread->startThread();
+
+    if (stepgenDMA != NULL) stepgenDMA->start();
+}
+
+
+void simSetClockError(int32_t ppm)
+{
+    // the timers count at SystemCoreClock / TIM_PSC, as the firmware assumes when it sets ARR,
+    // with the crystal off by ppm
+    nsPerCount = (TIM_PSC * 1e9) / (SystemCoreClock * (1.0 + ppm * 1e-6));
+}
+
+
+// the next timer to update and when, NULL when none is running
+static pruTimer* nextTimer(uint64_t& nextTime)
+{
+    pruTimer* next = NULL;
+
+    nextTime = UINT64_MAX;
+
+    // earliest deadline first, ties go to the thread started first (the Base thread)
+    for (std::vector<pruTimer*>::iterator it = simTimers.begin(); it != simTimers.end(); ++it)
+    {
+        if (!(*it)->isRunning()) continue;
+
+        uint64_t t = deadline(*it, stateOf(*it));
+
+        if (t < nextTime)
+        {
+            nextTime = t;
+            next = *it;
+        }
+    }
+
+    return next;
+}
+
+
+// CNT of the running timers at the current simulated time, brought up to date where the
+// firmware can read it
+static void updateCounters()
+{
+    for (std::vector<pruTimer*>::iterator it = simTimers.begin(); it != simTimers.end(); ++it)
+    {
+        if (!(*it)->isRunning()) continue;
+
+        simTimerState_t& state = stateOf(*it);
+        double counts = countsAt(simTime) - state.counts;
+
+        (*it)->getTimer()->CNT = counts < 0 ? 0 : counts >= state.period ? state.period - 1 : (uint32_t)counts;
+    }
+}
+
+
+void simStep()
+{
+    uint64_t nextTime;
+    pruTimer* next = nextTimer(nextTime);
+
+    if (next == NULL) return;
+
+    simTimerState_t& state = stateOf(next);
+
+    // the update event: the counter restarts and the preloaded ARR sets the next period
+    simTime = nextTime;
+    state.counts += state.period;
+    state.period = next->getTimer()->ARR + 1;
+    updateCounters();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    next->timerTick();
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    state.stats.ticks++;
+    state.stats.totalNs += ns;
+    if (ns < state.stats.minNs) state.stats.minNs = ns;
+    if (ns > state.stats.maxNs) state.stats.maxNs = ns;
+}
+
+
+void simRun(uint32_t basePeriods)
+{
+    uint64_t endTime = simTime + (basePeriods * 1000000000ULL) / PRU_BASEFREQ;
+
+    while (simTime < endTime && !simTimers.empty())
+    {
+        simStep();
+    }
+}
+
+
+void simRunUntil(uint64_t ns)
+{
+    uint64_t nextTime;
+
+    // the ticks due by then, and time moves on to part way through the next periods
+    while (nextTimer(nextTime) != NULL && nextTime <= ns)
+    {
+        simStep();
+    }
+
+    if (ns > simTime) simTime = ns;
+    updateCounters();
+}
+
+
+uint64_t simTimeNs()
+{
+    return simTime;
+}
+
+
+void simTransfer(const uint8_t* mosi, uint8_t* miso, int length)
+{
+    updateCounters();
+    comms.transfer(mosi, miso, length);
+}
+
+
+// "PE_2" style pin names, as used in the json configuration
+static bool portAndPin(const char* name, GPIO_TypeDef** port, uint16_t* pin)
+{
+    std::string p(name);
+
+    if (p.size() < 4 || p[0] != 'P') return false;
+
+    uint16_t pinNumber = p[3] - '0';
+    if (p.size() > 4 && (p[4] - '0') <= 9) pinNumber = pinNumber * 10 + (p[4] - '0');
+
+    if ((p[1] - 'A') >= SIM_GPIO_PORTS) return false;
+
+    *port = &simGPIO[p[1] - 'A'];
+    *pin = 1 << pinNumber;
+    return true;
+}
+
+bool simGetPin(const char* name)
+{
+    GPIO_TypeDef* port;
+    uint16_t pin;
+
+    if (!portAndPin(name, &port, &pin)) return false;
+    return (port->IDR & pin) != 0;
+}
+
+void simSetPin(const char* name, bool state)
+{
+    GPIO_TypeDef* port;
+    uint16_t pin;
+
+    if (!portAndPin(name, &port, &pin)) return;
+    if (state) port->IDR |= pin;
+    else port->IDR &= ~pin;
+}
+
+void simSetAnalog(const char* name, uint16_t value)
+{
+    GPIO_TypeDef* port;
+    uint16_t pin;
+
+    if (!portAndPin(name, &port, &pin)) return;
+
+    int portIndex = port - simGPIO;
+    int pinNumber = 0;
+    while ((1 << pinNumber) != pin) pinNumber++;
+
+    simAnalog[(portIndex << 4) | pinNumber] = value;
+}
+
+
+simThreadStats_t simGetStats(int thread)
+{
+    pruThread* threads[3] = {baseThread, servoThread, commsThread};
+    simThreadStats_t stats = {};
+
+    if (thread < 0 || thread > 2) return stats;
+
+    for (std::map<pruTimer*, simTimerState_t>::iterator it = timerState.begin(); it != timerState.end(); ++it)
+    {
+        if (it->first->getOwner() == threads[thread]) return it->second.stats;
+    }
+
+    return stats;
+}
+
+void simResetStats()
+{
+    for (std::map<pruTimer*, simTimerState_t>::iterator it = timerState.begin(); it != timerState.end(); ++it)
+    {
+        uint32_t frequency = it->second.stats.frequency;
+        it->second.stats = simThreadStats_t();
+        it->second.stats.frequency = frequency;
+        it->second.stats.minNs = UINT64_MAX;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+// Host simulation of the Remora PRU
+//
+// The common sources (modules/, drivers/, sensors/, thread/, lib/) are built together with this
+// TARGET_SIM directory, in place of TARGET_STM32F4, main.cpp and mbed-os, as the pru_sim library
+// of the CMakeLists.txt at the top of the repository:
+//
+//   cmake -S . -B build && cmake --build build --target pru_sim
+//
+// A harness linked with it replaces main(): simSetup(), simLoadModules(json),
+// simStartThreads(), and drives the threads with simStep() / simRun() while exchanging frames
+// with simTransfer(). cosim/cosim.cpp is one. Simulated time is exact and independent of the host, so runs are repeatable. The host
+// time spent inside each thread's run() is recorded for benchmarking and profiling.
+
+#include <cstdint>
+
+#include "configuration.h"
+#include "remora.h"
+
+typedef struct
+{
+    uint32_t frequency;         // thread frequency (Hz)
+    uint64_t ticks;             // number of thread invocations
+    uint64_t totalNs;           // host time spent in run()
+    uint64_t minNs;
+    uint64_t maxNs;
+} simThreadStats_t;
+
+void simSetup(void);                            // create the threads, as setup() does in main.cpp
+bool simLoadModules(const char*);               // parse a json configuration and load the modules
+void simStartThreads(void);                     // start the Base and Servo threads
+
+void simStep(void);                             // advance to the next thread tick and run it
+void simRun(uint32_t);                          // run for a number of Base thread periods
+void simRunUntil(uint64_t);                     // run the ticks due by a simulated time in ns, and stop at it
+void simSetClockError(int32_t);                 // PRU crystal error in ppm against simulated time, before simStartThreads()
+uint64_t simTimeNs(void);                       // simulated time since simSetup()
+
+void simTransfer(const uint8_t*, uint8_t*, int);    // SPI frame exchange with the simulated PRU, in bytes
+
+bool simGetPin(const char*);                    // read a pin, e.g. "PE_2"
+void simSetPin(const char*, bool);              // drive an input pin
+void simSetAnalog(const char*, uint16_t);       // set the ADC reading of an analog pin
+
+simThreadStats_t simGetStats(int);              // 0 = Base, 1 = Servo, 2 = Comms thread
+void simResetStats(void);
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef STM32F4XX_HAL_SIM_H
+#define STM32F4XX_HAL_SIM_H
+
+// Host simulation stand-in for the STM32Cube HAL
+//
+// Only the registers, types and calls used by the Remora sources are modelled. Peripherals
+// are plain structs in host memory so the simulator can inspect and drive them between
+// thread ticks. Nothing here generates interrupts, the simulator calls the thread run() methods.
+
+#include <cstddef>
+#include <cstdint>
+
+#define __IO    volatile
+
+typedef enum
+{
+    HAL_OK       = 0x00U,
+    HAL_ERROR    = 0x01U,
+    HAL_BUSY     = 0x02U,
+    HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+
+/***********************************************************************
+        INTERRUPTS
+************************************************************************/
+
+typedef enum
+{
+    EXTI4_IRQn                  = 10,
+    EXTI15_10_IRQn              = 40,
+    TIM1_BRK_TIM9_IRQn          = 24,
+    TIM1_UP_TIM10_IRQn          = 25,
+    TIM1_TRG_COM_TIM11_IRQn     = 26,
+    TIM3_IRQn                   = 29,
+    TIM8_CC_IRQn                = 46,
+    DMA2_Stream2_IRQn           = 58
+} IRQn_Type;
+
+inline void NVIC_EnableIRQ(IRQn_Type) {}
+inline void NVIC_DisableIRQ(IRQn_Type) {}
+inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+inline void NVIC_SetVector(IRQn_Type, uint32_t) {}
+inline void HAL_NVIC_SetPriority(IRQn_Type, uint32_t, uint32_t) {}
+
+inline void __NOP(void) {}
+
+extern uint32_t SystemCoreClock;
+
+
+/***********************************************************************
+        DWT CYCLE COUNTER
+************************************************************************/
+
+// CYCCNT follows host time scaled to SystemCoreClock, so cycle counts measured by the
+// firmware are a host based estimate rather than Cortex-M4 cycles
+class simCycleCounter
+{
+    private:
+
+        uint32_t offset;
+
+    public:
+
+        simCycleCounter() : offset(0) {}
+        operator uint32_t() const;
+        simCycleCounter& operator=(uint32_t);
+};
+
+typedef struct
+{
+    __IO uint32_t   CTRL;
+    simCycleCounter CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    __IO uint32_t   DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type simDWT;
+extern CoreDebug_Type simCoreDebug;
+
+#define DWT                         (&simDWT)
+#define CoreDebug                   (&simCoreDebug)
+
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+
+/***********************************************************************
+        GPIO
+************************************************************************/
+
+// a BSRR store sets and resets ODR bits, and the outputs are reflected in IDR
+class simBSRR
+{
+    public:
+
+        simBSRR& operator=(uint32_t);
+};
+
+typedef struct
+{
+    __IO uint32_t MODER;
+    __IO uint32_t OTYPER;
+    __IO uint32_t OSPEEDR;
+    __IO uint32_t PUPDR;
+    __IO uint32_t IDR;
+    __IO uint32_t ODR;
+    simBSRR       BSRR;
+    __IO uint32_t LCKR;
+    __IO uint32_t AFR[2];
+} GPIO_TypeDef;
+
+inline simBSRR& simBSRR::operator=(uint32_t value)
+{
+    GPIO_TypeDef* GPIOx = (GPIO_TypeDef*)((char*)this - offsetof(GPIO_TypeDef, BSRR));
+
+    GPIOx->ODR = (GPIOx->ODR & ~(value >> 16)) | (value & 0xFFFF);
+    GPIOx->IDR = (GPIOx->IDR & ~(value >> 16)) | (value & 0xFFFF);
+    return *this;
+}
+
+typedef enum
+{
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct
+{
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_MODE_INPUT             0x00000000U
+#define GPIO_MODE_OUTPUT_PP         0x00000001U
+#define GPIO_MODE_OUTPUT_OD         0x00000011U
+#define GPIO_MODE_AF_PP             0x00000002U
+#define GPIO_MODE_ANALOG            0x00000003U
+
+#define GPIO_NOPULL                 0x00000000U
+#define GPIO_PULLUP                 0x00000001U
+#define GPIO_PULLDOWN               0x00000002U
+
+#define GPIO_SPEED_FREQ_LOW         0x00000000U
+#define GPIO_SPEED_FREQ_HIGH        0x00000002U
+#define GPIO_SPEED_FREQ_VERY_HIGH   0x00000003U
+
+#define SIM_GPIO_PORTS              9           // GPIOA..GPIOI
+
+extern GPIO_TypeDef simGPIO[SIM_GPIO_PORTS];
+
+#define GPIOA   (&simGPIO[0])
+#define GPIOB   (&simGPIO[1])
+#define GPIOC   (&simGPIO[2])
+#define GPIOD   (&simGPIO[3])
+#define GPIOE   (&simGPIO[4])
+#define GPIOF   (&simGPIO[5])
+#define GPIOG   (&simGPIO[6])
+#define GPIOH   (&simGPIO[7])
+#define GPIOI   (&simGPIO[8])
+
+// outputs are reflected in IDR, as they are on the real port
+inline void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    if (PinState != GPIO_PIN_RESET)
+    {
+        GPIOx->ODR |= GPIO_Pin;
+        GPIOx->IDR |= GPIO_Pin;
+    }
+    else
+    {
+        GPIOx->ODR &= ~GPIO_Pin;
+        GPIOx->IDR &= ~GPIO_Pin;
+    }
+}
+
+inline GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+    return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+inline void HAL_GPIO_Init(GPIO_TypeDef*, GPIO_InitTypeDef*) {}
+
+
+/***********************************************************************
+        TIMERS AND SPI
+************************************************************************/
+
+typedef struct
+{
+    __IO uint32_t CR1;
+    __IO uint32_t CR2;
+    __IO uint32_t SMCR;
+    __IO uint32_t DIER;
+    __IO uint32_t SR;
+    __IO uint32_t EGR;
+    __IO uint32_t CCMR1;
+    __IO uint32_t CCMR2;
+    __IO uint32_t CCER;
+    __IO uint32_t CNT;
+    __IO uint32_t PSC;
+    __IO uint32_t ARR;
+    __IO uint32_t RCR;
+    __IO uint32_t CCR1;
+    __IO uint32_t CCR2;
+    __IO uint32_t CCR3;
+    __IO uint32_t CCR4;
+} TIM_TypeDef;
+
+#define TIM_CR1_CEN     (1UL)
+#define TIM_CR1_ARPE    (1UL << 7)     // the simulator always loads ARR at the update
+
+typedef struct
+{
+    __IO uint32_t CR1;
+    __IO uint32_t CR2;
+    __IO uint32_t SR;
+    __IO uint32_t DR;
+} SPI_TypeDef;
+
+extern TIM_TypeDef simTIM8, simTIM9, simTIM10, simTIM11;
+extern SPI_TypeDef simSPI1;
+
+#define TIM8    (&simTIM8)
+#define TIM9    (&simTIM9)
+#define TIM10   (&simTIM10)
+#define TIM11   (&simTIM11)
+#define SPI1    (&simSPI1)
+
+#endif
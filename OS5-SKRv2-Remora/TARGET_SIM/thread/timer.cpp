@@ -0,0 +1,55 @@
+#include "mbed.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+#include "timer.h"
+#include "pruThread.h"
+
+
+std::vector<pruTimer*> simTimers;
+
+
+// Timer constructor
+pruTimer::pruTimer(TIM_TypeDef* timer, IRQn_Type irq, uint32_t frequency, pruThread* ownerPtr):
+	timer(timer),
+	irq(irq),
+	frequency(frequency),
+	timerOwnerPtr(ownerPtr),
+	running(false)
+{
+	simTimers.push_back(this);
+
+	this->startTimer();
+}
+
+pruTimer::~pruTimer()
+{
+	simTimers.erase(std::remove(simTimers.begin(), simTimers.end(), this), simTimers.end());
+}
+
+
+void pruTimer::timerTick(void)
+{
+	if (this->running) this->timerOwnerPtr->run();
+}
+
+
+void pruTimer::startTimer(void)
+{
+	// mirror the period the hardware timer would use so ARR based code sees sensible values
+	this->timer->PSC = TIM_PSC-1;
+	this->timer->ARR = ((APB1CLK / TIM_PSC / this->frequency) - 1);
+	this->timer->CNT = 0;
+	this->timer->CR1 |= TIM_CR1_ARPE | TIM_CR1_CEN;
+
+	this->running = true;
+}
+
+void pruTimer::stopTimer()
+{
+	printf("	timer stop\n\r");
+	this->timer->CR1 &= ~TIM_CR1_CEN;
+
+	this->running = false;
+}
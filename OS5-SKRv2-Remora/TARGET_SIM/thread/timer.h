@@ -0,0 +1,47 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "mbed.h"
+#include <stdint.h>
+#include <vector>
+
+#define TIM_PSC 4
+#define APB1CLK SystemCoreClock
+#define APB2CLK SystemCoreClock/2
+
+class pruThread; // forward declatation
+
+// Host simulation stand-in for pruTimer
+//
+// There is no hardware timer or interrupt. Each running timer is listed in simTimers and the
+// simulator calls timerTick() when simulated time reaches the timer's next update, ARR + 1
+// counts after the last one. ARR is loaded at the update, as with ARPE set.
+
+class pruTimer
+{
+	private:
+
+		TIM_TypeDef* 	    timer;
+		IRQn_Type 			irq;
+		uint32_t 			frequency;
+		pruThread* 			timerOwnerPtr;
+		bool				running;
+
+		void startTimer(void);
+
+	public:
+
+		pruTimer(TIM_TypeDef* timer, IRQn_Type irq, uint32_t frequency, pruThread* ownerPtr);
+		~pruTimer();
+        void stopTimer(void);
+
+		void timerTick();				// called by the simulator in place of the timer ISR
+		bool isRunning(void) { return this->running; }
+		uint32_t getFrequency(void) { return this->frequency; }
+		TIM_TypeDef* getTimer(void) { return this->timer; }
+		pruThread* getOwner(void) { return this->timerOwnerPtr; }
+};
+
+extern std::vector<pruTimer*> simTimers;
+
+#endif
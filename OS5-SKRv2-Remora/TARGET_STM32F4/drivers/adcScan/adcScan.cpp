@@ -0,0 +1,136 @@
+#include "mbed.h"
+#include "stm32f4xx_hal.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "adcScan.h"
+
+
+AdcScan* adcScan = NULL;
+
+
+AdcScan::AdcScan() :
+    channels(0)
+{
+    this->ring = new uint16_t[ADC_SCAN_DEPTH * ADC_SCAN_CHANNELS];
+    memset(this->ring, 0, ADC_SCAN_DEPTH * ADC_SCAN_CHANNELS * sizeof(uint16_t));
+}
+
+
+int8_t AdcScan::addChannel(Pin* pin)
+{
+    int channel;
+
+    if (this->channels == ADC_SCAN_CHANNELS) return -1;
+
+    channel = pin->setAnalogFunction(ADC3);
+    if (channel < 0) return -1;
+
+    printf("  Scanning ADC3 channel %d\n", channel);
+
+    // the scan is restarted with the new channel, the ring layout changes with the length
+    if (this->channels > 0) this->stop();
+
+    this->adcChannel[this->channels] = channel;
+    this->channels++;
+
+    this->start(true);
+
+    return this->channels - 1;
+}
+
+
+void AdcScan::start(bool fill)
+{
+    uint32_t channel, timeout;
+
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_ADC3_CLK_ENABLE();
+
+    // the common ADC clock is PCLK2 / 4, 21 MHz, as mbed sets it for AnalogIn
+    ADC->CCR = (ADC->CCR & ~ADC_CCR_ADCPRE) | ADC_CCR_ADCPRE_0;
+
+    ADC3->CR2 = 0;
+    ADC3->CR1 = ADC_CR1_SCAN;                   // 12 bits
+    ADC3->SMPR1 = 0;
+    ADC3->SMPR2 = 0;
+    ADC3->SQR1 = (this->channels - 1) << 20;
+    ADC3->SQR2 = 0;
+    ADC3->SQR3 = 0;
+
+    for (uint8_t i = 0; i < this->channels; i++)
+    {
+        channel = this->adcChannel[i];
+
+        // 480 cycle sampling, and the channel's place in the regular sequence
+        if (channel < 10) ADC3->SMPR2 |= 7UL << (3 * channel);
+        else ADC3->SMPR1 |= 7UL << (3 * (channel - 10));
+
+        if (i < 6) ADC3->SQR3 |= channel << (5 * i);
+        else ADC3->SQR2 |= channel << (5 * (i - 6));
+    }
+
+    // ADC3 requests on DMA2 Stream 1 channel 2, at low priority behind the SPI and step streams
+    this->hdma.Instance                 = DMA2_Stream1;
+    this->hdma.Init.Channel             = DMA_CHANNEL_2;
+    this->hdma.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    this->hdma.Init.PeriphInc           = DMA_PINC_DISABLE;
+    this->hdma.Init.MemInc              = DMA_MINC_ENABLE;
+    this->hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    this->hdma.Init.MemDataAlignment    = DMA_MDATAALIGN_HALFWORD;
+    this->hdma.Init.Mode                = DMA_CIRCULAR;
+    this->hdma.Init.Priority            = DMA_PRIORITY_LOW;
+    this->hdma.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+
+    HAL_DMA_Init(&this->hdma);
+    HAL_DMA_Start(&this->hdma, (uint32_t)&ADC3->DR, (uint32_t)this->ring, ADC_SCAN_DEPTH * this->channels);
+
+    // continuous conversions with a DMA request for each, for as long as the DMA runs
+    ADC3->CR2 = ADC_CR2_ADON | ADC_CR2_CONT | ADC_CR2_DMA | ADC_CR2_DDS;
+    wait_us(10);                                // ADC power up
+    ADC3->CR2 |= ADC_CR2_SWSTART;
+
+    if (!fill) return;
+
+    // so the first reading is of the inputs, 4.5 ms for three channels
+    timeout = 100;
+    while (!__HAL_DMA_GET_FLAG(&this->hdma, __HAL_DMA_GET_TC_FLAG_INDEX(&this->hdma)) && timeout > 0)
+    {
+        wait_us(100);
+        timeout--;
+    }
+}
+
+
+void AdcScan::stop()
+{
+    ADC3->CR2 = 0;
+    HAL_DMA_Abort(&this->hdma);
+}
+
+
+uint16_t AdcScan::read(uint8_t place)
+{
+    uint32_t sum = 0;
+
+    for (uint32_t i = place; i < ADC_SCAN_DEPTH * this->channels; i += this->channels)
+    {
+        sum += this->ring[i];
+    }
+
+    return sum >> 2;                            // 64 x 12 bits to 16 bits
+}
+
+
+void AdcScan::service()
+{
+    // a conversion the DMA missed stops the requests, start again over the ring as it is
+    if (this->channels == 0 || !(ADC3->SR & ADC_SR_OVR)) return;
+
+    printf("ADC scan overrun, restarting\n");
+
+    this->stop();
+    ADC3->SR = ~ADC_SR_OVR;
+    this->start(false);
+}
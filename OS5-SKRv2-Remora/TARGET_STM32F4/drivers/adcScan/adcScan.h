@@ -0,0 +1,53 @@
+#ifndef ADCSCAN_H
+#define ADCSCAN_H
+
+#include "mbed.h"
+#include "stm32f4xx_hal.h"
+
+#include <cstdint>
+
+#include "drivers/pin/pin.h"
+
+#define ADC_SCAN_CHANNELS   8       // analog pins in the scan
+#define ADC_SCAN_DEPTH      64      // scans in the DMA ring, averaged by read()
+
+// Continuous DMA scan of the analog inputs
+//
+// ADC3 converts its channels in turn without stopping, and DMA2 Stream 1 writes each result
+// into a circular ring of the last 64 scans. Stream 0 of DMA2 receives the SPI frames and the
+// DMA Stepgen uses Stream 4, which are the ADC1 streams, so ADC3 on Stream 1 is the free one.
+// The F4 has no hardware oversampling, so each conversion samples for the longest time of 480
+// ADC clocks, about 23 us, and read() sums a channel over the ring. 64 of the 12 bit results
+// scale to the 0 - 65535 of AnalogIn::read_u16(). With three channels the ring holds the last
+// 4.5 ms, and a read takes the same time whenever it is made.
+//
+// A conversion the DMA misses sets the ADC overrun flag and stops the DMA requests. Restarting
+// the scan resets the DMA stream, which is too slow for the thread a read is made in, so the
+// main loop does it in service(). Until then read() gives the sums of the ring as it stopped.
+//
+// Only pins on ADC3 can be scanned, on the F407 those are PA0 - PA3, PC0 - PC3 and PF3 - PF10.
+
+class AdcScan
+{
+    private:
+
+        uint8_t             channels;                       // number of channels scanned
+        uint32_t            adcChannel[ADC_SCAN_CHANNELS];
+        uint16_t*           ring;                           // ADC_SCAN_DEPTH scans of all the channels
+        DMA_HandleTypeDef   hdma;
+
+        void start(bool);
+        void stop(void);
+
+    public:
+
+        AdcScan(void);
+
+        int8_t addChannel(Pin*);            // returns the channel's place in the scan, -1 if it can't be scanned
+        uint16_t read(uint8_t);             // sum of the ring as a 16 bit reading
+        void service(void);                 // restarts the scan after an overrun, from the main loop
+};
+
+extern AdcScan* adcScan;
+
+#endif
@@ -1,12 +1,20 @@
 #include "mbed.h"
 #include "RemoraComms.h"
+#include "pruThread.h"
 
 #include "stm32f4xx_hal.h"
 
 RemoraComms::RemoraComms(volatile rxData_t* ptrRxData, volatile txData_t* ptrTxData, SPI_TypeDef* spiType, PinName interruptPin) :
+    spiType(spiType),
     ptrRxData(ptrRxData),
     ptrTxData(ptrTxData),
-    spiType(spiType),
+    rxIndex(0),
+    commandFrame(NULL),
+    joints(JOINTS),
+    variables(VARIABLES),
+    sequence(0),
+    rejectCnt(0),
+    phaseLock(NULL),
     slaveSelect(interruptPin)
 {
     this->spiHandle.Instance = this->spiType;
@@ -68,8 +76,7 @@ void RemoraComms::init()
         this->hdma_spi_tx.Init.MemInc                = DMA_MINC_ENABLE;
         this->hdma_spi_tx.Init.PeriphDataAlignment   = DMA_PDATAALIGN_BYTE;
         this->hdma_spi_tx.Init.MemDataAlignment      = DMA_MDATAALIGN_BYTE;
-        this->hdma_spi_tx.Init.Mode                  = DMA_CIRCULAR;
-        //this->hdma_spi_tx.Init.Mode                  = DMA_NORMAL;
+        this->hdma_spi_tx.Init.Mode                  = DMA_NORMAL;          // re-armed for each frame, the frame size can change
         this->hdma_spi_tx.Init.Priority              = DMA_PRIORITY_VERY_HIGH;
         this->hdma_spi_tx.Init.FIFOMode              = DMA_FIFOMODE_DISABLE;
         
@@ -88,8 +95,7 @@ void RemoraComms::init()
         this->hdma_spi_rx.Init.MemInc                = DMA_MINC_ENABLE;
         this->hdma_spi_rx.Init.PeriphDataAlignment   = DMA_PDATAALIGN_BYTE;
         this->hdma_spi_rx.Init.MemDataAlignment      = DMA_MDATAALIGN_BYTE;
-        this->hdma_spi_rx.Init.Mode                  = DMA_CIRCULAR;
-        //this->hdma_spi_rx.Init.Mode                  = DMA_NORMAL;
+        this->hdma_spi_rx.Init.Mode                  = DMA_NORMAL;
         this->hdma_spi_rx.Init.Priority              = DMA_PRIORITY_VERY_HIGH;
         this->hdma_spi_rx.Init.FIFOMode              = DMA_FIFOMODE_DISABLE;
 
@@ -100,71 +106,134 @@ void RemoraComms::init()
         //HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 0, 0);
         //NVIC_SetVector(DMA2_Stream0_IRQn, (uint32_t)&DMA2_Stream0_IRQHandler);
         //HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
-
-        
-        this->hdma_memtomem_dma2_stream1.Instance                 = DMA2_Stream1;
-        this->hdma_memtomem_dma2_stream1.Init.Channel             = DMA_CHANNEL_0;
-        this->hdma_memtomem_dma2_stream1.Init.Direction           = DMA_MEMORY_TO_MEMORY;
-        this->hdma_memtomem_dma2_stream1.Init.PeriphInc           = DMA_PINC_ENABLE;
-        this->hdma_memtomem_dma2_stream1.Init.MemInc              = DMA_MINC_ENABLE;
-        this->hdma_memtomem_dma2_stream1.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-        this->hdma_memtomem_dma2_stream1.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-        this->hdma_memtomem_dma2_stream1.Init.Mode                = DMA_NORMAL;
-        this->hdma_memtomem_dma2_stream1.Init.Priority            = DMA_PRIORITY_LOW;
-        this->hdma_memtomem_dma2_stream1.Init.FIFOMode            = DMA_FIFOMODE_ENABLE;
-        this->hdma_memtomem_dma2_stream1.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
-        this->hdma_memtomem_dma2_stream1.Init.MemBurst            = DMA_MBURST_SINGLE;
-        this->hdma_memtomem_dma2_stream1.Init.PeriphBurst         = DMA_PBURST_SINGLE;
-
-        HAL_DMA_Init(&this->hdma_memtomem_dma2_stream1);
-
     }
+
+    // the frame CRC is calculated by the CRC unit
+    __HAL_RCC_CRC_CLK_ENABLE();
 }
 
 void RemoraComms::start()
 {
     this->ptrTxData->header = PRU_DATA;
-    HAL_SPI_TransmitReceive_DMA(&this->spiHandle, (uint8_t *)this->ptrTxData->txBuffer, (uint8_t *)this->spiRxBuffer.rxBuffer, SPI_BUFF_SIZE);
+    this->latchFeedback();
+    HAL_SPI_TransmitReceive_DMA(&this->spiHandle, (uint8_t *)this->txFrame, (uint8_t *)this->rxFrame[this->rxIndex], FRAME_SIZE(this->joints, this->variables));
+}
+
+void RemoraComms::setLayout(uint8_t joints, uint8_t variables)
+{
+    // set before start(), otherwise it takes effect when the DMA is re-armed at the end of the current frame
+    this->joints = joints;
+    this->variables = variables;
+    printf("SPI frame: %d joints, %d variables, %d bytes\n", joints, variables, FRAME_SIZE(joints, variables));
 }
 
 void RemoraComms::processPacket()
 {
-    switch (this->spiRxBuffer.header)
+    const uint32_t* frame = this->rxFrame[this->rxIndex];
+    uint32_t now = us_ticker_read();            // arrival time of the frame, for FrameTiming
+    uint32_t phase = this->phaseLock ? this->phaseLock->capture() : 0;
+
+    // the DMA is in NORMAL mode, stop it and drop any bytes beyond the frame. A host probing the
+    // layout sends a longer frame than the one armed
+    HAL_SPI_DMAStop(&this->spiHandle);
+    __HAL_SPI_CLEAR_OVRFLAG(&this->spiHandle);
+
+    // withdraw an unlatched command before its frame is re-armed, then latch the feedback for the
+    // next frame and re-arm the DMA into the other rx frame. The received frame is never copied
+    this->commandFrame = NULL;
+    this->rxIndex ^= 1;
+    this->latchFeedback();
+    HAL_SPI_TransmitReceive_DMA(&this->spiHandle, (uint8_t *)this->txFrame, (uint8_t *)this->rxFrame[this->rxIndex], FRAME_SIZE(this->joints, this->variables));
+
+    switch (((const frameHeader_t*)frame)->header)
     {
       case PRU_READ:
+        this->timing.frame(now, (const frameHeader_t*)frame, true);
         this->SPIdata = true;
         this->rejectCnt = 0;
         // READ so do nothing with the received data
         break;
 
       case PRU_WRITE:
-        this->SPIdata = true;
-        this->rejectCnt = 0;
-        // we've got a good WRITE header, move the data to rxData
-
-        // **** would like to use DMA for this but cannot when the stream is in CIRCULAR mode for the SPI transfer ****
-        // TODO: figure out how to use NORMAL mode for SPI...
-        //this->status = HAL_DMA_Start(&hdma_memtomem_dma2_stream1, (uint32_t)&this->spiRxBuffer.rxBuffer, (uint32_t)this->rxData->rxBuffer, SPI_BUFF_SIZE);
-        //if (this->status != HAL_OK) printf("F\n");
-
-        // Do it the slower way. This does not seem to impact performance but not great to stay in ISR context for longer.. :-(
-        for (int i = 0; i < SPI_BUFF_SIZE; i++)
+        // a WRITE is only handed to the threads with the right version, layout and CRC. The
+        // feedback goes out in the same frame, so the host's exchange function needs only one transfer
+        if (checkCommand(frame, this->joints, this->variables))
         {
-            this->ptrRxData->rxBuffer[i] = this->spiRxBuffer.rxBuffer[i];
+            this->timing.frame(now, (const frameHeader_t*)frame, true);
+            if (this->phaseLock) this->phaseLock->frame(phase);
+            this->commandFrame = frame;
+            this->SPIdata = true;
+            this->rejectCnt = 0;
+        }
+        else
+        {
+            this->timing.frame(now, (const frameHeader_t*)frame, false);
+            this->rejectPacket();
         }
-
         break;
 
       default:
-        this->rejectCnt++;
-        if (this->rejectCnt > 5)
-        {
-            this->SPIdataError = true;
-        }
-        // reset SPI somehow
+        this->timing.frame(now, (const frameHeader_t*)frame, false);
+        this->rejectPacket();
+    }
+}
+
+void RemoraComms::setPhaseLock(PhaseLock* phaseLock)
+{
+    this->phaseLock = phaseLock;
+}
+
+bool RemoraComms::latchCommand()
+{
+    // called from the Base thread, which preempts the chip select interrupt, so the frame can't
+    // be re-armed while it is unpacked
+    const uint32_t* frame = this->commandFrame;
+
+    if (frame == NULL) return false;
+
+    this->commandFrame = NULL;
+    unpackCommand(frame, this->ptrRxData, this->joints, this->variables);
+
+    return true;
+}
+
+void RemoraComms::latchFeedback()
+{
+    uint32_t generation;
+    uint32_t timing = this->timing.nextSlot();
+
+    // the threads preempt this interrupt and write txData, so pack it again if any thread ticked
+    // part way through. The frame then holds the feedback of one moment between two ticks
+    do
+    {
+        generation = pruThread::getGeneration();
+        packFeedback(this->txFrame, this->ptrTxData, this->sequence, this->joints, this->variables,
+                     this->timing.getTimestamp(), timing);
+    } while (generation != pruThread::getGeneration());
+
+    this->sequence++;
+}
+
+void RemoraComms::rejectPacket()
+{
+    this->rejectCnt++;
+    if (this->rejectCnt > 5)
+    {
+        this->SPIdataError = true;
+    }
+}
+
+
+uint32_t frameCRC(const uint32_t* data, uint32_t words)
+{
+    CRC->CR = CRC_CR_RESET;
+
+    while (words--)
+    {
+        CRC->DR = *data++;
     }
 
-    HAL_SPI_TransmitReceive_DMA(&this->spiHandle, (uint8_t *)this->ptrTxData->txBuffer, (uint8_t *)this->spiRxBuffer.rxBuffer, SPI_BUFF_SIZE);
+    return CRC->DR;
 }
 
 
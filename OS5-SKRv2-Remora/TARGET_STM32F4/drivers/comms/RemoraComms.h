@@ -4,6 +4,9 @@
 #include "mbed.h"
 #include "configuration.h"
 #include "remora.h"
+#include "remoraFrame.h"
+#include "frameTiming.h"
+#include "phaseLock.h"
 
 #include "stm32f4xx_hal.h"
 
@@ -17,25 +20,37 @@ class RemoraComms
         SPI_HandleTypeDef   spiHandle;
         DMA_HandleTypeDef   hdma_spi_tx;
         DMA_HandleTypeDef   hdma_spi_rx;
-        DMA_HandleTypeDef   hdma_memtomem_dma2_stream1;
         HAL_StatusTypeDef   status;
 
         volatile rxData_t*  ptrRxData;
         volatile txData_t*  ptrTxData;
-        rxData_t            spiRxBuffer;
+        uint32_t            rxFrame[2][FRAME_WORDS(JOINTS, VARIABLES)]; // SPI frames, see remora.h. The DMA fills one
+        uint32_t            txFrame[FRAME_WORDS(JOINTS, VARIABLES)];    // rx frame while the other is read
+        uint8_t             rxIndex;                // rx frame the DMA is filling
+        const uint32_t* volatile commandFrame;      // last validated WRITE, NULL once latched
+        uint8_t             joints;                 // frame layout
+        uint8_t             variables;
+        uint8_t             sequence;
         uint8_t             rejectCnt;
         bool                SPIdata;
         bool                SPIdataError;
+        FrameTiming         timing;                 // arrival of the host's frames
+        PhaseLock*          phaseLock;              // Base thread lock to the WRITE frames, NULL for none
         
         InterruptIn         slaveSelect;
         
         void processPacket(void);
+        void rejectPacket(void);
+        void latchFeedback(void);
 
     public:
 
         RemoraComms(volatile rxData_t*, volatile txData_t*, SPI_TypeDef*, PinName);
         void init(void);
         void start(void);
+        void setLayout(uint8_t, uint8_t);       // joints and variables carried in the frame
+        void setPhaseLock(PhaseLock*);
+        bool latchCommand(void);                // move a new WRITE to rxData, run by CommandLatch
         bool getStatus(void);
         void setStatus(bool);
         bool getError(void);
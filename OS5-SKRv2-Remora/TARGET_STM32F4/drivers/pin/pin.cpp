@@ -6,6 +6,8 @@
 #include <string>
 
 #include "stm32f4xx_hal.h"
+#include "pinmap.h"
+#include "PeripheralPins.h"
 
 Pin::Pin(std::string portAndPin, int dir) :
     portAndPin(portAndPin),
@@ -196,4 +198,42 @@ PinName Pin::pinToPinName()
 {
     printf("PinName = 0x%x\n", (this->portIndex << 4) | this->pinNumber);
     return static_cast<PinName>((this->portIndex << 4) | this->pinNumber);
-}
\ No newline at end of file
+}
+
+
+bool Pin::setTimerFunction(TIM_TypeDef* timer, uint32_t channel)
+{
+    PinName name = static_cast<PinName>((this->portIndex << 4) | this->pinNumber);
+
+    // the channels of each timer are listed in the target's PWM pin map, the ALTx names of a pin
+    // are the same pin on another timer
+    for (const PinMap* map = PinMap_PWM; map->pin != NC; map++)
+    {
+        if ((map->pin & 0xFF) == name && (uint32_t)map->peripheral == (uint32_t)timer &&
+            STM_PIN_CHANNEL(map->function) == channel && !STM_PIN_INVERTED(map->function))
+        {
+            pin_function(map->pin, map->function);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+int Pin::setAnalogFunction(ADC_TypeDef* adc)
+{
+    PinName name = static_cast<PinName>((this->portIndex << 4) | this->pinNumber);
+
+    // as for the timers, the ALTx names in the ADC pin map are the same pin on another ADC
+    for (const PinMap* map = PinMap_ADC; map->pin != NC; map++)
+    {
+        if ((map->pin & 0xFF) == name && (uint32_t)map->peripheral == (uint32_t)adc)
+        {
+            pin_function(map->pin, map->function);
+            return STM_PIN_CHANNEL(map->function);
+        }
+    }
+
+    return -1;
+}
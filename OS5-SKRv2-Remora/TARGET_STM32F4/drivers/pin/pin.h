@@ -48,6 +48,18 @@ class Pin
         void pull_up();
         void pull_down();
         PinName pinToPinName();
+        bool setTimerFunction(TIM_TypeDef*, uint32_t);     // alternate function of a timer channel 1 - 4
+        int setAnalogFunction(ADC_TypeDef*);                // analog input of an ADC, returns its channel or -1
+
+        inline GPIO_TypeDef* getPort()
+        {
+            return this->GPIOx;
+        }
+
+        inline uint16_t getPin()
+        {
+            return this->pin;       // GPIO_PIN_x mask, as used for BSRR writes
+        }
 
         inline bool get()
         {
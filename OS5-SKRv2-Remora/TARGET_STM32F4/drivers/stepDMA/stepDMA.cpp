@@ -0,0 +1,128 @@
+#include "mbed.h"
+#include "stm32f4xx_hal.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "interrupt.h"
+#include "stepDMA.h"
+#include "stepDMAInterrupt.h"
+#include "timerClaim.h"
+#include "modules/stepgenDMA/stepgenDMA.h"
+
+
+// TIM8 compare DMA requests on DMA2, see the DMA2 request mapping in RM0090
+static DMA_Stream_TypeDef* const dmaStream[DMA_STREAMS] = { DMA2_Stream2, DMA2_Stream4, DMA2_Stream7 };
+static const uint32_t dmaRequest[DMA_STREAMS] = { TIM_DIER_CC1DE, TIM_DIER_CC3DE, TIM_DIER_CC4DE };
+
+
+StepDMA::StepDMA(uint32_t frequency, uint32_t blockSize, StepgenDMA* owner) :
+    owner(owner),
+    frequency(frequency),
+    blockSize(blockSize),
+    streams(0)
+{
+    this->interruptPtr = new StepDMAInterrupt(DMA2_Stream2_IRQn, this);
+}
+
+
+bool StepDMA::claim()
+{
+    return claimTimer(TIM8, "DMA Stepgen");
+}
+
+
+int8_t StepDMA::addPort(GPIO_TypeDef* port)
+{
+    for (uint8_t i = 0; i < this->streams; i++)
+    {
+        if (this->port[i] == port) return i;
+    }
+
+    if (this->streams == DMA_STREAMS) return -1;
+
+    this->port[this->streams] = port;
+    this->buffer[this->streams] = new uint32_t[2 * this->blockSize];
+    memset(this->buffer[this->streams], 0, 2 * this->blockSize * sizeof(uint32_t));
+
+    return this->streams++;
+}
+
+
+void StepDMA::start()
+{
+    printf("Starting step DMA at %d Hz, %d streams\n", this->frequency, this->streams);
+
+    // both blocks are played before the first interrupt asks for a refill
+    this->owner->fillBlock(0);
+    this->owner->fillBlock(1);
+
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_TIM8_CLK_ENABLE();
+
+    TIM8->CR1 = 0;
+    TIM8->DIER = 0;
+
+    for (uint8_t i = 0; i < this->streams; i++)
+    {
+        this->hdma[i].Instance                 = dmaStream[i];
+        this->hdma[i].Init.Channel             = DMA_CHANNEL_7;
+        this->hdma[i].Init.Direction           = DMA_MEMORY_TO_PERIPH;
+        this->hdma[i].Init.PeriphInc           = DMA_PINC_DISABLE;
+        this->hdma[i].Init.MemInc              = DMA_MINC_ENABLE;
+        this->hdma[i].Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+        this->hdma[i].Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
+        this->hdma[i].Init.Mode                = DMA_CIRCULAR;
+        this->hdma[i].Init.Priority            = DMA_PRIORITY_HIGH;
+        this->hdma[i].Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+
+        HAL_DMA_Init(&this->hdma[i]);
+
+        // the first stream paces the buffer refills
+        if (i == 0) __HAL_DMA_ENABLE_IT(&this->hdma[i], DMA_IT_HT | DMA_IT_TC);
+
+        HAL_DMA_Start(&this->hdma[i], (uint32_t)this->buffer[i], (uint32_t)&this->port[i]->BSRR, 2 * this->blockSize);
+
+        TIM8->DIER |= dmaRequest[i];
+    }
+
+    // TIM8 is on APB2 and is clocked at the core clock, compare events at CNT = 0 once per period
+    TIM8->PSC = 0;
+    TIM8->ARR = (SystemCoreClock / this->frequency) - 1;
+    TIM8->CCR1 = 0;
+    TIM8->CCR3 = 0;
+    TIM8->CCR4 = 0;
+    TIM8->EGR = TIM_EGR_UG;
+
+    NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+
+    TIM8->CR1 |= TIM_CR1_CEN;
+}
+
+
+void StepDMA::stop()
+{
+    NVIC_DisableIRQ(DMA2_Stream2_IRQn);
+
+    TIM8->CR1 &= ~TIM_CR1_CEN;
+    TIM8->DIER = 0;
+
+    for (uint8_t i = 0; i < this->streams; i++)
+    {
+        HAL_DMA_Abort(&this->hdma[i]);
+    }
+}
+
+
+void StepDMA::transferComplete()
+{
+    // refill the block the DMA has just finished, NDTR counts down through the two blocks
+    if (dmaStream[0]->NDTR > this->blockSize)
+    {
+        this->owner->fillBlock(1);
+    }
+    else
+    {
+        this->owner->fillBlock(0);
+    }
+}
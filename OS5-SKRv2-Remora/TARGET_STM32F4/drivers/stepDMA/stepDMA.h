@@ -0,0 +1,55 @@
+#ifndef STEPDMA_H
+#define STEPDMA_H
+
+#include "mbed.h"
+#include "stm32f4xx_hal.h"
+
+#include <cstdint>
+
+#define DMA_STREAMS     3           // TIM8 CH1, CH3 and CH4 DMA requests, one GPIO port each
+
+class StepgenDMA;                   // forward declaration
+class StepDMAInterrupt;             // forward declaration
+
+// Timer triggered DMA of BSRR words to the GPIO ports
+//
+// TIM8 runs at the DMA frequency and its compare events request a word transfer on up to three
+// DMA2 streams, each writing a circular buffer of two blocks to the BSRR of one port. The half
+// and full transfer interrupts of the first stream ask the owner to fill the block that has just
+// been played, while the DMA plays the other one.
+
+class StepDMA
+{
+    friend class StepDMAInterrupt;
+
+    private:
+
+        StepDMAInterrupt*   interruptPtr;
+        StepgenDMA*         owner;
+        uint32_t            frequency;
+        uint32_t            blockSize;          // words per block, the buffers are two blocks long
+        uint8_t             streams;            // number of streams in use
+
+        GPIO_TypeDef*       port[DMA_STREAMS];
+        uint32_t*           buffer[DMA_STREAMS];
+        DMA_HandleTypeDef   hdma[DMA_STREAMS];
+
+        void transferComplete(void);            // called from the DMA2 Stream 2 interrupt
+
+    public:
+
+        StepDMA(uint32_t frequency, uint32_t blockSize, StepgenDMA* owner);
+
+        static bool claim(void);                // claims TIM8, false if another module holds it
+
+        int8_t addPort(GPIO_TypeDef*);          // returns the stream for the port, -1 if all are in use
+        uint32_t* getBuffer(uint8_t stream) { return this->buffer[stream]; }
+        uint8_t getStreams(void) { return this->streams; }
+        uint32_t getBlockSize(void) { return this->blockSize; }
+        uint32_t getFrequency(void) { return this->frequency; }
+
+        void start(void);
+        void stop(void);
+};
+
+#endif
@@ -0,0 +1,20 @@
+#include "interrupt.h"
+#include "stepDMAInterrupt.h"
+#include "stepDMA.h"
+
+
+StepDMAInterrupt::StepDMAInterrupt(int interruptNumber, StepDMA* owner)
+{
+	// Allows interrupt to access owner's data
+	InterruptOwnerPtr = owner;
+
+	// When a device interrupt object is instantiated, the Register function must be called to let the
+	// Interrupt base class know that there is an appropriate ISR function for the given interrupt.
+	Interrupt::Register(interruptNumber, this);
+}
+
+
+void StepDMAInterrupt::ISR_Handler(void)
+{
+	this->InterruptOwnerPtr->transferComplete();
+}
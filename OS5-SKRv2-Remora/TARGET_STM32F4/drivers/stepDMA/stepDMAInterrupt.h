@@ -0,0 +1,21 @@
+#ifndef STEPDMAINTERRUPT_H
+#define STEPDMAINTERRUPT_H
+
+// Derived class for the step DMA transfer interrupts
+
+class StepDMA; // forward declatation
+
+class StepDMAInterrupt : public Interrupt
+{
+	private:
+
+		StepDMA* InterruptOwnerPtr;
+
+	public:
+
+		StepDMAInterrupt(int interruptNumber, StepDMA* ownerptr);
+
+		void ISR_Handler(void);
+};
+
+#endif
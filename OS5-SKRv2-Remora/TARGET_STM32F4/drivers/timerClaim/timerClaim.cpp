@@ -0,0 +1,63 @@
+#include "timerClaim.h"
+
+#include <cstring>
+
+#define TIMER_CLAIMS    14          // TIM1 - TIM14
+
+typedef struct
+{
+    TIM_TypeDef*    timer;
+    const char*     owner;
+    uint32_t        period;         // us, TIMER_EXCLUSIVE for the whole timer
+    uint32_t        channels;       // bit n - 1 set while channel n is held
+} timerClaim_t;
+
+static timerClaim_t claims[TIMER_CLAIMS];
+static int claimCount = 0;
+
+
+static timerClaim_t* findClaim(TIM_TypeDef* timer)
+{
+    for (int i = 0; i < claimCount; i++)
+    {
+        if (claims[i].timer == timer) return &claims[i];
+    }
+
+    return NULL;
+}
+
+
+bool claimTimer(TIM_TypeDef* timer, const char* owner, uint32_t period, uint32_t channel)
+{
+    timerClaim_t* claim = findClaim(timer);
+    uint32_t mask = (channel >= 1 && channel <= 4) ? 1UL << (channel - 1) : 0;
+
+    if (claim == NULL)
+    {
+        if (claimCount == TIMER_CLAIMS) return false;
+
+        claim = &claims[claimCount++];
+        claim->timer = timer;
+        claim->owner = owner;
+        claim->period = period;
+        claim->channels = (period == TIMER_EXCLUSIVE) ? 0xF : mask;
+
+        return true;
+    }
+
+    // only a shared counter, by the same owner at the same period, on a channel still free
+    if (period == TIMER_EXCLUSIVE || claim->period != period || strcmp(claim->owner, owner) != 0) return false;
+    if (claim->channels & mask) return false;
+
+    claim->channels |= mask;
+
+    return true;
+}
+
+
+const char* timerOwner(TIM_TypeDef* timer)
+{
+    timerClaim_t* claim = findClaim(timer);
+
+    return (claim != NULL) ? claim->owner : NULL;
+}
@@ -0,0 +1,27 @@
+#ifndef TIMERCLAIM_H
+#define TIMERCLAIM_H
+
+#include "mbed.h"
+#include "stm32f4xx_hal.h"
+
+#include <cstdint>
+
+#define TIMER_EXCLUSIVE     0       // period of a claim on the whole timer
+
+// Claims on the STM32 timers
+//
+// The modules are created in the order of the JSON config, so the timer registers can't tell a
+// module whether a later one needs its timer. Every user of a timer claims it here first, the
+// threads in setup() and the modules as they are created, and a claim is refused while another
+// owner holds the timer.
+//
+// A claim with a period of TIMER_EXCLUSIVE holds the counter and all four channels. A claim with
+// a period, in us, holds the counter running at that period and the one channel given, 0 for
+// none. A later claim by the same owner at the same period shares the counter and takes another
+// free channel, so hardware PWMs of one frequency run on one timer and the probe captures on a
+// channel of the Base thread's timer.
+
+bool claimTimer(TIM_TypeDef* timer, const char* owner, uint32_t period = TIMER_EXCLUSIVE, uint32_t channel = 0);
+const char* timerOwner(TIM_TypeDef* timer);         // NULL while the timer is free
+
+#endif
@@ -0,0 +1,180 @@
+#include "probe.h"
+#include "modules/stepgen/stepgenBank.h"
+#include "drivers/timerClaim/timerClaim.h"
+#include "timer.h"
+
+/***********************************************************************
+                MODULE CONFIGURATION AND CREATION FROM JSON
+************************************************************************/
+void createProbe()
+{
+    const char* comment = module["Comment"];
+    printf("%s\n",comment);
+
+    const char* pin = module["Probe Pin"];
+    int dataBit = module["Data Bit"];
+    const char* edge = module["Edge"];                  // "Rising" or "Falling", optional
+    uint32_t filter = module["Filter"];                 // optional, 0 - 15
+    JsonArray joints = module["Joints"];
+    JsonArray pvs = module["PV[i]"];                    // one for each joint
+
+    printf("Creating probe at pin %s\n", pin);
+
+    ptrInputs = &txData.inputs;
+
+    // TIM9 runs the Base thread, see setup() in main.cpp
+    Probe* probe = new Probe(TIM9, *ptrInputs, dataBit, pin, edge != nullptr && !strcmp(edge, "Falling"), filter);
+
+    if (!probe->configProbe())
+    {
+        printf("Probe not created, the Probe Pin must be channel 1 or 2 of TIM9, not in use by another probe\n");
+        return;
+    }
+
+    // the joints' Stepgens must be configured ahead of the probe
+    for (size_t i = 0; i < joints.size() && i < pvs.size(); i++)
+    {
+        int joint = joints[i];
+        int pv = pvs[i];
+        Stepgen* stepgen = NULL;
+
+        for (size_t j = 0; stepgenBank != NULL && j < stepgenBank->size(); j++)
+        {
+            if ((*stepgenBank)[j]->getJointNumber() == joint) stepgen = (*stepgenBank)[j];
+        }
+
+        if (stepgen == NULL)
+        {
+            printf("  No Stepgen for joint %d, not latched by the probe\n", joint);
+            continue;
+        }
+
+        printf("  Joint %d latched to PV[%d]\n", joint, pv);
+
+        ptrProcessVariable[pv] = &txData.processVariable[pv];
+        probe->addJoint(stepgen, *ptrJointFeedback[joint], *ptrProcessVariable[pv]);
+    }
+
+    // registered, so it runs after the Stepgen bank in each Base tick
+    baseThread->registerModule(probe);
+}
+
+
+/***********************************************************************
+                METHOD DEFINITIONS
+************************************************************************/
+
+Probe::Probe(TIM_TypeDef* timer, volatile uint8_t &ptrData, int bitNumber, std::string pin, bool activeLow, uint32_t filter) :
+	timer(timer),
+	channel(0),
+	period(0),
+	filter(filter & 0xF),
+	activeLow(activeLow),
+	ptrData(&ptrData),
+	latched(false),
+	hold(0)
+{
+	this->probePin = new Pin(pin, INPUT);
+	this->mask = 1 << bitNumber;
+	this->holdTicks = (PRU_BASEFREQ / PRU_SERVOFREQ) * 3;		// so the host sees the latch
+}
+
+
+bool Probe::configProbe()
+{
+	uint32_t ccmr, ccer;
+
+	// the channel is claimed on the counter of the Base thread, see setup() in main.cpp
+	for (uint32_t channel = 1; channel <= 2 && this->channel == 0; channel++)
+	{
+		if (this->probePin->setTimerFunction(this->timer, channel) &&
+			claimTimer(this->timer, "Base thread", 1000000 / PRU_BASEFREQ, channel)) this->channel = channel;
+	}
+
+	if (this->channel == 0) return false;
+
+	// the period pruTimer sets for the Base thread. ARR holds the preloaded next period, which
+	// the phase lock trims
+	this->period = APB1CLK / TIM_PSC / PRU_BASEFREQ;
+
+	// input capture of the channel's own pin, the timer keeps counting the Base period
+	ccmr = (this->channel - 1) * 8;
+	ccer = (this->channel - 1) * 4;
+
+	this->timer->CCER &= ~((TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC1NP) << ccer);
+	this->timer->CCMR1 = (this->timer->CCMR1 & ~(0xFFUL << ccmr)) | ((TIM_CCMR1_CC1S_0 | (this->filter << 4)) << ccmr);
+	this->timer->CCER |= (TIM_CCER_CC1E | (this->activeLow ? TIM_CCER_CC1P : 0)) << ccer;
+	this->timer->SR = ~(TIM_SR_CC1IF << (this->channel - 1));
+
+	return true;
+}
+
+
+void Probe::addJoint(Stepgen* stepgen, volatile int32_t &ptrFeedback, volatile float &ptrOffset)
+{
+	joint_t joint;
+
+	joint.stepgen = stepgen;
+	joint.ptrFeedback = &ptrFeedback;
+	joint.ptrOffset = &ptrOffset;
+	joint.edgePosition = 0;
+	joint.stepScale = 1.0f / (float)(1L << stepgen->getStepBit());
+
+	this->joints.push_back(joint);
+}
+
+
+void Probe::update()
+{
+	uint32_t flag = TIM_SR_CC1IF << (this->channel - 1);
+	uint32_t status = this->timer->SR;
+	uint32_t now = this->timer->CNT;					// after the flag, so a capture this tick is at or before it
+	uint32_t capture;
+	int32_t before, addValue;
+
+	if (status & flag)
+	{
+		capture = (&this->timer->CCR1)[this->channel - 1];	// reading it clears the flag
+
+		if (!this->latched)
+		{
+			// counts from the edge to this tick. A capture later in the count than now was in the
+			// last period, before this tick's steps, an earlier one is during this tick
+			before = (capture > now) ? (int32_t)(this->period - capture) : -(int32_t)capture;
+
+			for (size_t i = 0; i < this->joints.size(); i++)
+			{
+				joint_t& joint = this->joints[i];
+
+				// back along the add value of this tick, which took the position from the last tick to this one
+				addValue = joint.stepgen->getEnabled() ? joint.stepgen->getAddValue() : 0;
+				joint.edgePosition = (uint32_t)joint.stepgen->getCommandPosition() - (int32_t)(((int64_t)addValue * before) / (int32_t)this->period);
+			}
+
+			this->latched = true;
+			this->hold = this->holdTicks;
+			*(this->ptrData) |= this->mask;
+		}
+	}
+
+	if (!this->latched) return;
+
+	// the feedback moves on every tick, so the offset follows it. The difference is taken in the
+	// wrapping DDS units
+	for (size_t i = 0; i < this->joints.size(); i++)
+	{
+		joint_t& joint = this->joints[i];
+
+		*(joint.ptrOffset) = (float)(int32_t)(joint.edgePosition - (uint32_t)*(joint.ptrFeedback)) * joint.stepScale;
+	}
+
+	if (this->hold > 0)
+	{
+		this->hold--;
+	}
+	else if (this->probePin->get() == this->activeLow)		// released
+	{
+		this->latched = false;
+		*(this->ptrData) &= ~this->mask;
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "mbed.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "modules/module.h"
+#include "modules/stepgen/stepgen.h"
+#include "drivers/pin/pin.h"
+#include "stm32f4xx_hal.h"
+
+#include "extern.h"
+
+void createProbe(void);
+
+// Probe input latched by input capture on the Base thread timer
+//
+// The Probe Pin must be channel 1 or 2 of TIM9, the timer behind the Base thread. The timer
+// captures its count on the probe edge, which places the edge within the Base period to one
+// timer count rather than to the next thread tick. Run after the Stepgens, the module takes
+// the command position of each joint at the edge from the tick before and after it.
+//
+// The 32 bit command position wraps after a few hundred steps, so each PV gets the position at
+// the edge less the joint feedback in the same frame, in steps. The host adds it to pos-fb
+// times the scale. The Data Bit is set from the edge until the probe is released, for at least
+// 3 servo periods, and the PVs are only kept up to date while it is set.
+
+class Probe : public Module
+{
+	private:
+
+		typedef struct
+		{
+			Stepgen*			stepgen;
+			volatile int32_t*	ptrFeedback;	// joint feedback sent to the host
+			volatile float*		ptrOffset;		// PV, position at the edge less the feedback
+			uint32_t			edgePosition;	// command position at the edge, DDS units
+			float				stepScale;		// steps per DDS unit
+		} joint_t;
+
+		std::vector<joint_t>	joints;
+		Pin*					probePin;
+		TIM_TypeDef*			timer;
+		uint32_t				channel;		// capture channel of the timer, 0 until configured
+		uint32_t				period;			// nominal Base period in timer counts, the phase lock trims ARR
+		uint32_t				filter;			// ICxF input filter, 0 - 15
+		bool					activeLow;		// latch on the falling edge
+		volatile uint8_t*		ptrData;
+		int						mask;
+		bool					latched;
+		uint32_t				hold;			// Base ticks left before the latch can be released
+		uint32_t				holdTicks;
+
+	public:
+
+		Probe(TIM_TypeDef*, volatile uint8_t&, int, std::string, bool, uint32_t);
+
+		bool configProbe(void);
+		void addJoint(Stepgen*, volatile int32_t&, volatile float&);
+
+		virtual void update(void);
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "hardwarePwm.h"
+#include "drivers/timerClaim/timerClaim.h"
+
+#define PID_PWM_MAX 256		// PWM Max is on the 8 bit scale of the software PWM
+
+
+/***********************************************************************
+                METHOD DEFINITIONS
+************************************************************************/
+
+HardwarePWM::HardwarePWM(volatile float &ptrPeriodSP, volatile float &ptrSP, int period, std::string pin, int pwmMax) :
+	ptrPeriodSP(&ptrPeriodSP),
+	ptrSP(&ptrSP),
+	period(period),
+	timer(NULL),
+	channel(0),
+	compare(0)
+{
+	printf("Creating variable frequency hardware PWM @ pin %s\n", pin.c_str());
+
+	this->pwmPin = new Pin(pin, OUTPUT);
+	this->maxDuty = (pwmMax > 0 && pwmMax < PID_PWM_MAX) ? (float)pwmMax / PID_PWM_MAX : 1.0f;
+}
+
+
+HardwarePWM::HardwarePWM(volatile float &ptrSP, int period, std::string pin, int pwmMax) :
+	ptrPeriodSP(NULL),
+	ptrSP(&ptrSP),
+	period(period),
+	timer(NULL),
+	channel(0),
+	compare(0)
+{
+	printf("Creating hardware PWM @ pin %s\n", pin.c_str());
+
+	this->pwmPin = new Pin(pin, OUTPUT);
+	this->maxDuty = (pwmMax > 0 && pwmMax < PID_PWM_MAX) ? (float)pwmMax / PID_PWM_MAX : 1.0f;
+}
+
+
+HardwarePWM::~HardwarePWM()
+{
+	// only deleted when it is not configured, the pin may be left on a timer channel
+	this->pwmPin->setAsInput();
+	delete this->pwmPin;
+}
+
+
+bool HardwarePWM::configPWM()
+{
+	static TIM_TypeDef* const timers[] = { TIM1, TIM2, TIM3, TIM4, TIM8, TIM12, TIM13, TIM14 };
+
+	// a variable frequency needs a timer of its own, a fixed one shares with PWMs of its period
+	uint32_t period = (this->ptrPeriodSP != NULL || this->period <= 0) ? TIMER_EXCLUSIVE : this->period;
+	bool shared = false;
+	uint32_t shift;
+	volatile uint32_t* ccmr;
+
+	// the first timer with the pin on a channel that can be claimed
+	for (uint32_t i = 0; i < sizeof(timers) / sizeof(timers[0]) && this->channel == 0; i++)
+	{
+		TIM_TypeDef* timer = timers[i];
+
+		for (uint32_t channel = 1; channel <= 4 && this->channel == 0; channel++)
+		{
+			if (!this->pwmPin->setTimerFunction(timer, channel)) continue;
+
+			shared = (timerOwner(timer) != NULL);
+
+			if (claimTimer(timer, "PWM", period, channel))
+			{
+				this->timer = timer;
+				this->channel = channel;
+			}
+		}
+	}
+
+	if (this->channel == 0) return false;
+
+	if (this->timer == TIM1) __HAL_RCC_TIM1_CLK_ENABLE();
+	else if (this->timer == TIM2) __HAL_RCC_TIM2_CLK_ENABLE();
+	else if (this->timer == TIM3) __HAL_RCC_TIM3_CLK_ENABLE();
+	else if (this->timer == TIM4) __HAL_RCC_TIM4_CLK_ENABLE();
+	else if (this->timer == TIM8) __HAL_RCC_TIM8_CLK_ENABLE();
+	else if (this->timer == TIM12) __HAL_RCC_TIM12_CLK_ENABLE();
+	else if (this->timer == TIM13) __HAL_RCC_TIM13_CLK_ENABLE();
+	else if (this->timer == TIM14) __HAL_RCC_TIM14_CLK_ENABLE();
+
+	this->timerClock = this->getTimerClock();
+
+	if (!shared)
+	{
+		// up counting with a preloaded period, the update event loads the prescaler and period
+		this->timer->CR1 = TIM_CR1_ARPE;
+		this->setPeriod(this->period);
+		this->timer->EGR = TIM_EGR_UG;
+		this->timer->CR1 |= TIM_CR1_CEN;
+	}
+
+	// PWM mode 1 with a preloaded compare, the output is high while the count is below it
+	shift = ((this->channel - 1) & 1) * 8;
+	ccmr = (this->channel <= 2) ? &this->timer->CCMR1 : &this->timer->CCMR2;
+
+	(&this->timer->CCR1)[this->channel - 1] = 0;
+	this->compare = 0;
+	*ccmr = (*ccmr & ~(0xFFUL << shift)) | ((TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE) << shift);
+	this->timer->CCER = (this->timer->CCER & ~((TIM_CCER_CC1P | TIM_CCER_CC1NE | TIM_CCER_CC1NP) << ((this->channel - 1) * 4)))
+						| (TIM_CCER_CC1E << ((this->channel - 1) * 4));
+
+	// the outputs of the advanced timers also need the main output enable
+	if (IS_TIM_BREAK_INSTANCE(this->timer)) this->timer->BDTR |= TIM_BDTR_MOE;
+
+	printf("  PWM on timer channel %lu, %lu timer counts per period\n", (unsigned long)this->channel, (unsigned long)this->timer->ARR + 1);
+
+	return true;
+}
+
+
+uint32_t HardwarePWM::getTimerClock()
+{
+	// TIM1 and TIM8 are on APB2, and a timer runs at twice its APB clock when the APB is divided
+	if (this->timer == TIM1 || this->timer == TIM8)
+	{
+		return HAL_RCC_GetPCLK2Freq() * ((RCC->CFGR & RCC_CFGR_PPRE2_2) ? 2 : 1);
+	}
+
+	return HAL_RCC_GetPCLK1Freq() * ((RCC->CFGR & RCC_CFGR_PPRE1_2) ? 2 : 1);
+}
+
+
+void HardwarePWM::setPeriod(int32_t period)
+{
+	// counts per prescaled period, kept below 2^32 on TIM2 so ARR + 1 fits the compare
+	uint64_t top = IS_TIM_32B_COUNTER_INSTANCE(this->timer) ? 0xFFFFFFFFULL : 0x10000ULL;
+	uint64_t ticks = ((uint64_t)this->timerClock * (uint32_t)period) / 1000000;
+	uint32_t psc;
+
+	// the smallest prescaler that fits the period into the counter keeps the most duty resolution
+	if (ticks < 2) ticks = 2;
+	if (ticks > top * 0x10000) ticks = top * 0x10000;
+
+	psc = (ticks - 1) / top;
+
+	this->timer->PSC = psc;
+	this->timer->ARR = (uint32_t)(ticks / (psc + 1) - 1);
+}
+
+
+void HardwarePWM::update()
+{
+	float duty = *(this->ptrSP);
+	int32_t period;
+	uint32_t compare;
+
+	if (this->ptrPeriodSP != NULL)
+	{
+		period = (int32_t)*(this->ptrPeriodSP);
+
+		if (period <= 0)
+		{
+			duty = 0;
+		}
+		else if (period != this->period)
+		{
+			this->period = period;
+			this->setPeriod(period);
+		}
+	}
+
+	// ensure SP is within range. LinuxCNC PID can have -ve command value
+	if (duty > 100) duty = 100;
+	if (duty < 0) duty = 0;
+
+	// the duty in 1/65536 of the period. The ARR read back is the preloaded value, taken with
+	// the compare at the next update event
+	compare = (uint32_t)(duty * this->maxDuty * 655.36f);
+	compare = (uint32_t)(((uint64_t)(this->timer->ARR + 1) * compare) >> 16);
+
+	if (compare != this->compare)
+	{
+		(&this->timer->CCR1)[this->channel - 1] = compare;
+		this->compare = compare;
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef HARDWAREPWM_H
+#define HARDWAREPWM_H
+
+#include "mbed.h"
+#include <cstdint>
+#include <string>
+
+#include "modules/module.h"
+#include "drivers/pin/pin.h"
+#include "stm32f4xx_hal.h"
+
+#include "extern.h"
+
+// PWM output from a timer channel
+//
+// The PWM Pin must be a channel of TIM1, TIM2, TIM3, TIM4, TIM8, TIM12, TIM13 or TIM14 in
+// PinMap_PWM, on a timer not claimed by another module such as a QEI or the DMA Stepgen, see
+// claimTimer(). The timer generates the waveform, update() in the Servo thread only writes the
+// compare register when the duty changes and, for a variable frequency, the period registers
+// when the period changes. Both are preloaded, so a change takes effect at the start of the
+// next PWM period.
+//
+// The prescaler is the smallest that fits the period in the timer's 16 bits (32 for TIM2),
+// so the duty has 16 bits of resolution up to about 1.3 kHz on the 84 MHz timers and 2.6 kHz
+// on TIM1 and TIM8, and one timer count at any frequency above. The SP is the duty in %,
+// limited to PWM Max / 256 when a PWM Max is given, as for the software PWM. The Period SP of
+// a variable frequency PWM is the period in us, a period of 0 or less holds the output low.
+//
+// Channels of a timer share its period, so a fixed frequency PWM only shares a timer with
+// others of the same period and a variable frequency PWM needs a timer of its own.
+
+class HardwarePWM : public Module
+{
+	private:
+
+		volatile float*		ptrPeriodSP;	// period in us, NULL for a fixed frequency
+		volatile float*		ptrSP;			// duty in %
+		int32_t				period;			// us
+		float				maxDuty;		// fraction of the period
+		Pin*				pwmPin;
+		TIM_TypeDef*		timer;
+		uint32_t			channel;		// 1 - 4, 0 until configured
+		uint32_t			timerClock;		// Hz
+		uint32_t			compare;		// last value written to the compare register
+
+		uint32_t getTimerClock(void);
+		void setPeriod(int32_t);
+
+	public:
+
+		HardwarePWM(volatile float&, volatile float&, int, std::string, int);	// variable frequency
+		HardwarePWM(volatile float&, int, std::string, int);					// fixed frequency
+		virtual ~HardwarePWM();													// returns the pin to an input
+
+		bool configPWM(void);
+
+		virtual void update(void);
+};
+
+#endif
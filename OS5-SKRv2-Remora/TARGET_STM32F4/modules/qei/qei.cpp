@@ -1,8 +1,9 @@
 #include "mbed.h"
 #include "qei.h"
+#include "drivers/timerClaim/timerClaim.h"
 
 /***********************************************************************
-                MODULE CONFIGURATION AND CREATION FROM JSON     
+                MODULE CONFIGURATION AND CREATION FROM JSON
 ************************************************************************/
 void createQEI()
 {
@@ -12,87 +13,186 @@ void createQEI()
     int pv = module["PV[i]"];
     int dataBit = module["Data Bit"];
     const char* index = module["Enable Index"];
+    const char* timerName = module["Timer"];            // optional, TIM1
+    const char* pinA = module["ChA Pin"];               // optional with TIM1, PE_9
+    const char* pinB = module["ChB Pin"];               // optional with TIM1, PE_11
+    const char* pinI = module["Index Pin"];             // optional with TIM1, PE_13
+    uint32_t filter = module["Filter"];                 // optional, 0 - 15
+    int velocityPv = module["Velocity PV[i]"] | -1;     // optional
+
+    TIM_TypeDef* timer = NULL;
+    QEI* qei;
+
+    // without a timer, the BTT SKR2 pins of the TIM1 interface
+    if (timerName == nullptr)
+    {
+        timerName = "TIM1";
+        if (pinA == nullptr) pinA = "PE_9";
+        if (pinB == nullptr) pinB = "PE_11";
+        if (pinI == nullptr) pinI = "PE_13";
+    }
+
+    // TIM5 is the mbed us_ticker, and TIM9 - 11 run the threads
+    if (!strcmp(timerName,"TIM1")) timer = TIM1;
+    else if (!strcmp(timerName,"TIM2")) timer = TIM2;
+    else if (!strcmp(timerName,"TIM3")) timer = TIM3;
+    else if (!strcmp(timerName,"TIM4")) timer = TIM4;
+    else if (!strcmp(timerName,"TIM8")) timer = TIM8;
 
-    printf("Creating QEI, hardware quadrature encoder interface\n");
+    if (timer == NULL || pinA == nullptr || pinB == nullptr)
+    {
+        printf("QEI not created, it needs a Timer of TIM1, TIM2, TIM3, TIM4 or TIM8 and the ChA and ChB Pins\n");
+        return;
+    }
+
+    printf("Creating QEI, hardware quadrature encoder interface on %s at pins %s and %s\n", timerName, pinA, pinB);
 
     ptrProcessVariable[pv]  = &txData.processVariable[pv];
     ptrInputs = &txData.inputs;
 
-    if (!strcmp(index,"True"))
+    if (index != nullptr && !strcmp(index,"True") && pinI != nullptr)
     {
-        printf("  Encoder has index\n");
-        Module* qei = new QEI(*ptrProcessVariable[pv], *ptrInputs, dataBit);
-        baseThread->registerModule(qei);
+        printf("  Encoder has index at pin %s\n", pinI);
+        qei = new QEI(*ptrProcessVariable[pv], *ptrInputs, dataBit, timer, pinA, pinB, pinI, filter);
     }
     else
     {
-        Module* qei = new QEI(*ptrProcessVariable[pv]);
-        baseThread->registerModule(qei);
+        qei = new QEI(*ptrProcessVariable[pv], timer, pinA, pinB, filter);
+    }
+
+    if (!qei->configQEI())
+    {
+        printf("QEI not created\n");
+        delete qei;
+        return;
     }
+
+    if (velocityPv >= 0)
+    {
+        printf("  Encoder velocity to PV[%d]\n", velocityPv);
+        ptrProcessVariable[velocityPv] = &txData.processVariable[velocityPv];
+        qei->setVelocity(*ptrProcessVariable[velocityPv]);
+    }
+
+    counters[pv] = qei;
+    baseThread->registerModule(qei);
 }
 
 /***********************************************************************
 *                METHOD DEFINITIONS                                    *
 ************************************************************************/
 
-QEI::QEI(volatile float &ptrEncoderCount) :
+QEI::QEI(volatile float &ptrEncoderCount, TIM_TypeDef* timer, std::string ChA, std::string ChB, uint32_t filter) :
+    qeiIndex(NULL),
 	ptrEncoderCount(&ptrEncoderCount),
-    qeiIndex(NC)
+    filter(filter & 0xF),
+    indexChannel(0)
 {
+    this->htim.Instance = timer;
+    this->pinA = new Pin(ChA, INPUT);
+    this->pinB = new Pin(ChB, INPUT);
+    this->pinI = NULL;
     this->hasIndex = false;
-    this->configQEI();
+    this->indexDetected = false;
+    this->counter = 0;
+    this->position = 0;
+    this->velocity = NULL;
 }
 
-QEI::QEI(volatile float &ptrEncoderCount, volatile uint8_t &ptrData, int bitNumber) :
-	ptrEncoderCount(&ptrEncoderCount),
+QEI::QEI(volatile float &ptrEncoderCount, volatile uint8_t &ptrData, int bitNumber, TIM_TypeDef* timer, std::string ChA, std::string ChB, std::string Index, uint32_t filter) :
+    qeiIndex(NULL),
     ptrData(&ptrData),
     bitNumber(bitNumber),
-    qeiIndex(PE_13)
+	ptrEncoderCount(&ptrEncoderCount),
+    filter(filter & 0xF),
+    indexChannel(0)
 {
+    this->htim.Instance = timer;
+    this->pinA = new Pin(ChA, INPUT);
+    this->pinB = new Pin(ChB, INPUT);
+    this->pinI = new Pin(Index, INPUT);
     this->hasIndex = true;
     this->indexDetected = false;
-    this->indexPulse = 100;                             
-	this->count = 0;								    
-    this->indexCount = 0;
-    this->oldIndexCount = 0;
-    this->pulseCount = 0;                               
+    this->indexPulse = 100;
+    this->counter = 0;
+    this->position = 0;
+    this->indexCounter = 0;
+    this->indexPosition = 0;
+    this->pulseCount = 0;
     this->mask = 1 << this->bitNumber;
-
-    this->irq = EXTI15_10_IRQn;
+    this->velocity = NULL;
+}
 
 
-    this->configQEI();
+QEI::~QEI()
+{
+    // only deleted when it is not configured, the pins may be left on the timer channels
+    this->pinA->setAsInput();
+    this->pinB->setAsInput();
+    delete this->pinA;
+    delete this->pinB;
 
-    qeiIndex.rise(callback(this, &QEI::interruptHandler));
-    //NVIC_EnableIRQ(this->irq);
-    HAL_NVIC_SetPriority(this->irq, 0, 0);
+    if (this->pinI != NULL)
+    {
+        this->pinI->setAsInput();
+        delete this->pinI;
+    }
 }
 
 
 void QEI::interruptHandler()
 {
+    this->indexCounter = this->htim.Instance->CNT;
     this->indexDetected = true;
-    this->indexCount = this->getPosition();
 }
 
 
-uint32_t QEI::getPosition()
+int32_t QEI::countSince(uint32_t count)
 {
-    return __HAL_TIM_GET_COUNTER(&htim);
+    // the difference is taken in the counter's width, so a wrap between updates is carried
+    return (int32_t)((count - this->counter) << this->shift) >> this->shift;
+}
+
+
+int64_t QEI::getPosition()
+{
+    return this->position;
+}
+
+
+int32_t QEI::getCount()
+{
+    return (int32_t)this->position;
+}
+
+
+void QEI::setVelocity(volatile float &ptrVelocity)
+{
+    // measured over at least a servo period, slower than 1 count/s reads as 0
+    this->ptrVelocity = &ptrVelocity;
+    this->velocity = new VelocityEstimator(PRU_BASEFREQ, PRU_BASEFREQ / PRU_SERVOFREQ, PRU_BASEFREQ);
 }
 
 
 void QEI::update()
 {
-    this->count = getPosition();
+    uint32_t count = this->htim.Instance->CNT;
+
+    // reading the capture register clears its flag
+    if (this->indexChannel && (this->htim.Instance->SR & (TIM_SR_CC1IF << (this->indexChannel - 1))))
+    {
+        this->indexCounter = (&this->htim.Instance->CCR1)[this->indexChannel - 1];
+        this->indexDetected = true;
+    }
 
     if (this->hasIndex)                                     // we have an index pin
     {
         // handle index, index pulse and pulse count
         if (this->indexDetected && (this->pulseCount == 0))    // index interrupt occured: rising edge on index pulse
         {
-            *(this->ptrEncoderCount) = this->indexCount;
-            this->pulseCount = this->indexPulse;        
+            this->indexPosition = this->position + this->countSince(this->indexCounter);
+            *(this->ptrEncoderCount) = this->indexPosition;
+            this->pulseCount = this->indexPulse;
             *(this->ptrData) |= this->mask;                 // set bit in data source high
         }
         else if (this->pulseCount > 0)                      // maintain both index output and encoder count for the latch period
@@ -103,25 +203,61 @@ void QEI::update()
         else
         {
             *(this->ptrData) &= ~this->mask;                // set bit in data source low
-            *(this->ptrEncoderCount) = this->count;         // update encoder count
         }
     }
-    else
+
+    this->position += this->countSince(count);
+    this->counter = count;
+
+    if (!this->hasIndex || this->pulseCount == 0)
     {
-        *(this->ptrEncoderCount) = this->count;             // update encoder count
+        *(this->ptrEncoderCount) = this->position;          // update encoder count
+    }
+
+    if (this->velocity != NULL)
+    {
+        this->velocity->update((uint32_t)this->position);
+        *(this->ptrVelocity) = this->velocity->get();
     }
 }
 
+
 // reference https://os.mbed.com/users/gregeric/code/Nucleo_Hello_Encoder/
 
-void QEI::configQEI()
+bool QEI::configQEI()
 {
+    TIM_TypeDef* timer = this->htim.Instance;
+    uint16_t indexPin;
+    IRQn_Type irq;
+
     printf("  Configuring hardware QEI module\n");
 
-    this->htim.Instance = TIM1;
+    if (!this->pinA->setTimerFunction(timer, 1) || !this->pinB->setTimerFunction(timer, 2))
+    {
+        printf("  The ChA and ChB Pins must be channel 1 and 2 of the timer\n");
+        return false;
+    }
+
+    // the encoder mode and the index capture take the whole timer. It is claimed once the encoder
+    // runs, so a failure below leaves it free
+    if (timerOwner(timer) != NULL)
+    {
+        printf("  The timer is in use by the %s\n", timerOwner(timer));
+        return false;
+    }
+
+    if (timer == TIM1) __HAL_RCC_TIM1_CLK_ENABLE();
+    else if (timer == TIM2) __HAL_RCC_TIM2_CLK_ENABLE();
+    else if (timer == TIM3) __HAL_RCC_TIM3_CLK_ENABLE();
+    else if (timer == TIM4) __HAL_RCC_TIM4_CLK_ENABLE();
+    else if (timer == TIM8) __HAL_RCC_TIM8_CLK_ENABLE();
+
+    // TIM2 has a 32 bit counter, the others 16 bits
+    this->shift = (timer == TIM2) ? 0 : 16;
+
     this->htim.Init.Prescaler = 0;
     this->htim.Init.CounterMode = TIM_COUNTERMODE_UP;
-    this->htim.Init.Period = 65535;
+    this->htim.Init.Period = this->shift ? 0xFFFF : 0xFFFFFFFF;
     this->htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
     this->htim.Init.RepetitionCounter = 0;
 
@@ -130,47 +266,67 @@ void QEI::configQEI()
     this->sConfig.IC1Polarity = TIM_ICPOLARITY_RISING;
     this->sConfig.IC1Selection = TIM_ICSELECTION_DIRECTTI;
     this->sConfig.IC1Prescaler = TIM_ICPSC_DIV1;
-    this->sConfig.IC1Filter = 0;
+    this->sConfig.IC1Filter = this->filter;
 
     this->sConfig.IC2Polarity = TIM_ICPOLARITY_RISING;
     this->sConfig.IC2Selection = TIM_ICSELECTION_DIRECTTI;
     this->sConfig.IC2Prescaler = TIM_ICPSC_DIV1;
-    this->sConfig.IC2Filter = 0;
+    this->sConfig.IC2Filter = this->filter;
 
     if (HAL_TIM_Encoder_Init(&this->htim, &this->sConfig) != HAL_OK)
     {
         printf("Couldn't Init Encoder\r\n");
+        HAL_TIM_Encoder_DeInit(&this->htim);
+        return false;
     }
 
     this->sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
     this->sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
     HAL_TIMEx_MasterConfigSynchronization(&this->htim, &this->sMasterConfig);
 
-    if (HAL_TIM_Encoder_Start(&this->htim, TIM_CHANNEL_2)!=HAL_OK)
+    timer->CNT = 0;
+    this->counter = 0;
+
+    if (HAL_TIM_Encoder_Start(&this->htim, TIM_CHANNEL_ALL)!=HAL_OK)
     {
         printf("Couldn't Start Encoder\r\n");
+        HAL_TIM_Encoder_DeInit(&this->htim);
+        return false;
     }
-}
 
+    claimTimer(timer, "QEI");
 
-void HAL_TIM_Encoder_MspInit(TIM_HandleTypeDef* htim_encoder)
-{
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    if(htim_encoder->Instance==TIM1)
-    {
-        __HAL_RCC_TIM1_CLK_ENABLE();
-
-        __HAL_RCC_GPIOE_CLK_ENABLE();
-        /**TIM1 GPIO Configuration
-        PE9     ------> TIM1_CH1
-        PE11     ------> TIM1_CH2
-        */
-        GPIO_InitStruct.Pin = GPIO_PIN_9|GPIO_PIN_11;
-        GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-        GPIO_InitStruct.Alternate = GPIO_AF1_TIM1;
-        HAL_GPIO_Init(GPIOE, &GPIO_InitStruct);
+    if (this->hasIndex)
+    {
+        // the index on channel 3 or 4 captures the count on its rising edge, through the same filter
+        for (uint32_t channel = 3; channel <= 4 && this->indexChannel == 0; channel++)
+        {
+            if (this->pinI->setTimerFunction(timer, channel)) this->indexChannel = channel;
+        }
+
+        if (this->indexChannel)
+        {
+            printf("  Index captured by channel %lu\n", (unsigned long)this->indexChannel);
+
+            timer->CCER &= ~((TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC1NP) << ((this->indexChannel - 1) * 4));
+            timer->CCMR2 = (timer->CCMR2 & ~(0xFFUL << ((this->indexChannel - 3) * 8))) |
+                           ((TIM_CCMR2_CC3S_0 | (this->filter << 4)) << ((this->indexChannel - 3) * 8));
+            timer->CCER |= TIM_CCER_CC1E << ((this->indexChannel - 1) * 4);
+            timer->SR = ~(TIM_SR_CC1IF << (this->indexChannel - 1));
+        }
+        else
+        {
+            // the EXTI line of the index pin, lines 0 - 4 have an interrupt each
+            indexPin = this->pinI->getPin();
+            if (indexPin & 0xFC00) irq = EXTI15_10_IRQn;
+            else if (indexPin & 0x03E0) irq = EXTI9_5_IRQn;
+            else irq = (IRQn_Type)(EXTI0_IRQn + __builtin_ctz(indexPin));
+
+            this->qeiIndex = new InterruptIn(this->pinI->pinToPinName());
+            this->qeiIndex->rise(callback(this, &QEI::interruptHandler));
+            HAL_NVIC_SetPriority(irq, 0, 0);
+        }
     }
-}
 
+    return true;
+}
@@ -3,15 +3,41 @@
 
 #include "mbed.h"
 #include <cstdint>
+#include <string>
 
 #include "modules/module.h"
+#include "drivers/pin/pin.h"
+#include "modules/encoder/velocityEstimator.h"
+#include "modules/encoder/counter.h"
 #include "stm32f4xx_hal.h"
 
 #include "extern.h"
 
 void createQEI(void);
 
-class QEI : public Module
+// Quadrature encoder counted in hardware by a timer in encoder mode
+//
+// Any of TIM1, TIM2, TIM3, TIM4 or TIM8 can be used, with ChA and ChB on the timer's channel 1
+// and 2 pins as listed in PinMap_PWM, as long as no other module has claimed the timer, see
+// claimTimer(). The timer counts every edge of both channels, at up to a quarter of the timer
+// clock, so the count no longer depends on the Base thread polling the pins. The input filter
+// takes the timer's ICxF setting (0 - 15) for both channels, an edge must hold for 2 to 8
+// samples of up to fDTS/32 before it is counted.
+//
+// The timer is claimed once the encoder is running. A QEI that fails to configure leaves the
+// timer free, and deleting it returns the pins to inputs.
+//
+// An Index Pin on channel 3 or 4 of the same timer is an input capture, so the count at the
+// index edge is latched by the timer itself. Any other Index Pin is read by an interrupt.
+//
+// The timer's 16 or 32 bit counter is extended in update() to a 64 bit position, which stays
+// right as long as the counter moves by less than half its range between two updates. The PV
+// is that position as a float, exact up to 2^24 counts, and a PositionLoop reads it through
+// getCount(). A Velocity PV gets the velocity in counts/s, see VelocityEstimator. The count is
+// read in the Base thread, so the velocity has the resolution of a Base tick, +-2.5 % over a
+// 1 ms window at 40 kHz, however finely the timer counts the edges.
+
+class QEI : public Module, public Counter
 {
 
 	private:
@@ -20,32 +46,45 @@ class QEI : public Module
         TIM_Encoder_InitTypeDef sConfig  = {0};
         TIM_MasterConfigTypeDef sMasterConfig  = {0};
 
-        InterruptIn             qeiIndex;
-        IRQn_Type 		        irq;
+        InterruptIn*            qeiIndex;
 
         bool                    hasIndex;
-        bool                    indexDetected;
+        volatile bool           indexDetected;
         volatile uint8_t*       ptrData; 	// pointer to the data source
 		int                     bitNumber;				// location in the data source
         int                     mask;
 
 		volatile float*         ptrEncoderCount; 	// pointer to the data source
-
-        int32_t                 count;
-        int32_t                 indexCount;
-        int32_t                 oldIndexCount;
+        volatile float*         ptrVelocity;        // counts/s, when a Velocity PV is configured
+        VelocityEstimator*      velocity;
+
+        uint32_t                filter;             // ICxF input filter, 0 - 15
+        uint32_t                indexChannel;       // timer channel capturing the index, 0 for the interrupt
+        uint32_t                shift;              // 16 for a 16 bit counter, 0 for 32 bits
+        uint32_t                counter;            // timer count at the last update
+        volatile uint32_t       indexCounter;       // timer count at the index
+        int64_t                 position;           // extended count
+        int64_t                 indexPosition;
         int8_t                  indexPulse;
         int8_t                  pulseCount;
 
         void interruptHandler();
+        int32_t countSince(uint32_t);               // counts from the last update to a timer count
 
 	public:
 
-        QEI(volatile float&);                           // for channel A & B on BTT SKR2 pins PE_9 and PE_11
-        QEI(volatile float&, volatile uint8_t&, int);   // For channels A & B, and index on BTT SKR2 pin PE_13
+		Pin* pinA;      // channel A
+        Pin* pinB;      // channel B
+        Pin* pinI;      // index
+
+        QEI(volatile float&, TIM_TypeDef*, std::string, std::string, uint32_t);
+        QEI(volatile float&, volatile uint8_t&, int, TIM_TypeDef*, std::string, std::string, std::string, uint32_t);
+        virtual ~QEI();
 
-        void configQEI(void);
-        uint32_t getPosition(void);
+        bool configQEI(void);
+        int64_t getPosition(void);                  // extended count at the last update
+        virtual int32_t getCount(void);             // its low 32 bits
+        void setVelocity(volatile float&);          // report the velocity to a second PV
 
 		virtual void update(void);
 };
@@ -15,7 +15,7 @@ void TIM9_IRQHandler()
 {
   if(TIM9->SR & TIM_SR_UIF) // if UIF flag is set
   {
-    TIM9->SR &= ~TIM_SR_UIF; // clear UIF flag
+    TIM9->SR = ~TIM_SR_UIF; // clear UIF flag only, a read-modify-write could clear a capture flag set in between
     
     Interrupt::TIM9_Wrapper();
   }
@@ -39,4 +39,14 @@ void TIM11_IRQHandler()
     
     Interrupt::TIM11_Wrapper();
   }
+}
+
+void DMA2_Stream2_IRQHandler()
+{
+  if(DMA2->LISR & (DMA_LISR_HTIF2 | DMA_LISR_TCIF2)) // half or full transfer of the step DMA
+  {
+    DMA2->LIFCR = DMA_LIFCR_CHTIF2 | DMA_LIFCR_CTCIF2; // clear the flags
+
+    Interrupt::DMA2_Stream2_Wrapper();
+  }
 }
\ No newline at end of file
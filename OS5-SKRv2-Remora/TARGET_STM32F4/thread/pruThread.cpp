@@ -1,43 +0,0 @@
-#include "pruThread.h"
-#include "modules/module.h"
-
-
-using namespace std;
-
-// Thread constructor
-pruThread::pruThread(TIM_TypeDef* timer, IRQn_Type irq, uint32_t frequency) :
-	timer(timer),
-	irq(irq),
-	frequency(frequency)
-{
-	printf("Creating thread %d\n", this->frequency);
-}
-
-void pruThread::startThread(void)
-{
-	TimerPtr = new pruTimer(this->timer, this->irq, this->frequency, this);
-}
-
-void pruThread::stopThread(void)
-{
-    this->TimerPtr->stopTimer();
-}
-
-
-void pruThread::registerModule(Module* module)
-{
-	this->vThread.push_back(module);
-}
-
-
-void pruThread::unregisterModule(Module* module)
-{
-	iter = std::remove(vThread.begin(),vThread.end(), module);
-    vThread.erase(iter, vThread.end());
-}
-
-void pruThread::run(void)
-{
-	// iterate over the Thread pointer vector to run all instances of Module::runModule()
-	for (iter = vThread.begin(); iter != vThread.end(); ++iter) (*iter)->runModule();
-}
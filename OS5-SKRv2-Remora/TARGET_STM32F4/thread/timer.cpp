@@ -68,6 +68,7 @@ void pruTimer::startTimer(void)
     this->timer->ARR = ((TIM_CLK / TIM_PSC / this->frequency) - 1);   // period           
     this->timer->EGR = TIM_EGR_UG;                                    // reinit the counter
     this->timer->DIER = TIM_DIER_UIE;                                 // enable update interrupts
+    this->timer->CR1 |= TIM_CR1_ARPE;                                 // ARR preloaded, a trimmed period starts at the next update
 
     this->timer->CR1 |= TIM_CR1_CEN;                                  // enable timer
 
@@ -1,11 +1,17 @@
 #ifndef CONFIGURATION_H
 #define CONFIGURATION_H
 
+#ifndef PRU_BASEFREQ
 #define PRU_BASEFREQ    	40000 //24000   // PRU Base thread ISR update frequency (hz)
+#endif
 #define PRU_SERVOFREQ       1000            // PRU Servo thread ISR update freqency (hz)
 #define OVERSAMPLE          3
 #define SWBAUDRATE          19200           // Software serial baud rate
 #define PRU_COMMSFREQ       (SWBAUDRATE * OVERSAMPLE)
+#define PRU_DMAFREQ         400000          // DMA Stepgen output frequency (hz), the maximum step rate is PRU_DMAFREQ/2
+#ifndef PHASE_LOCK
+#define PHASE_LOCK          1               // trim the Base thread period to the host's WRITE frames, 0 to free run
+#endif
 
 #define STEPBIT     		22            	// bit location in DDS accum
 #define STEP_MASK   		  (1L<<STEPBIT)
@@ -31,8 +37,11 @@
 #define SPI_ERR_MAX         5
 // PRU reset will occur in SPI_ERR_MAX * LOOP_TIME = 0.5sec
 
+#define STATS_TIME          100
+// thread timing statistics are printed every STATS_TIME * LOOP_TIME = 10sec
+
 // SPI configuration
-#define SPI_BUFF_SIZE 		64            	// Size of SPI recieve buffer - same as HAL component, 64
+#define SPI_BUFF_SIZE 		96            	// Size of the rxData and txData unions, rxData is the larger
 
 //#define MOSI0               P0_18           // RPi SPI
 //#define MISO0               P0_17
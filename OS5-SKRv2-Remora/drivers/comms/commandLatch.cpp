@@ -0,0 +1,42 @@
+#include "commandLatch.h"
+
+#include "extern.h"
+
+
+CommandLatch::CommandLatch(RemoraComms& comms, pruThread* servo) :
+	comms(comms),
+	servo(servo),
+	ticks(0),
+	interval(0)
+{
+	commandTimeout = false;
+	commandTicks = 0;
+	commandInterval = 0;
+}
+
+
+void CommandLatch::update()
+{
+	if (this->ticks < UINT32_MAX) this->ticks++;
+
+	// latch a waiting command, unless the Base thread has preempted a Servo tick. Then try again
+	// on the next Base tick
+	if (!this->servo->isRunning() && this->comms.latchCommand())
+	{
+		// the interval up to a late command is the gap, not the host period, so it is measured
+		// again from the next one
+		this->interval = commandTimeout ? 0 : this->ticks;
+
+		this->ticks = 0;
+		commandTimeout = false;
+	}
+	else if (this->interval && this->ticks > this->interval + this->interval / 2)
+	{
+		// half a period late, the frame is lost. The next one may still come, the modules that
+		// act on a timeout pick up again from its command
+		commandTimeout = true;
+	}
+
+	commandTicks = this->ticks;
+	commandInterval = this->interval;
+}
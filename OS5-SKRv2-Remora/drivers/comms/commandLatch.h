@@ -0,0 +1,34 @@
+#ifndef COMMANDLATCH_H
+#define COMMANDLATCH_H
+
+#include "modules/module.h"
+#include "thread/pruThread.h"
+#include "RemoraComms.h"
+
+// Moves the last WRITE frame that RemoraComms validated into rxData. It is scheduled first in
+// the Base thread, so every module sees a command as soon as the thread after its frame runs.
+// While the Servo thread is part way through a tick the latch waits, so a Servo tick also reads
+// one command from start to end
+//
+// The latch also times the commands in Base ticks. When a command is half a host period late
+// it sets commandTimeout, so the step generators can bring the axes to a controlled stop well
+// before the main loop's comms error count resets the PRU. The count since the last command and
+// the interval are published for the modules that spread a command over the host period
+
+class CommandLatch : public Module
+{
+	private:
+
+		RemoraComms&	comms;
+		pruThread*		servo;			// the lower priority thread that reads rxData
+		uint32_t		ticks;			// Base ticks since the last command
+		uint32_t		interval;		// Base ticks between the last two commands, 0 until measured
+
+	public:
+
+		CommandLatch(RemoraComms&, pruThread*);
+
+		virtual void update(void);
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "frameTiming.h"
+
+#define MAX_INTERVAL    1000000     // us, a longer gap is the host stopping rather than jitter
+
+
+FrameTiming::FrameTiming() :
+    lastWrite(0),
+    meanInterval(0),
+    sequence(0),
+    slot(0),
+    started(false),
+    timed(false)
+{
+    for (int i = 0; i < FRAME_SLOTS; i++)
+    {
+        this->count[i] = 0;
+    }
+}
+
+
+void FrameTiming::frame(uint32_t now, const frameHeader_t* header, bool accepted)
+{
+    uint32_t interval, difference;
+    uint8_t bin;
+
+    if (!accepted)
+    {
+        // the sequence number of a rejected frame can't be trusted, take it as the next one
+        this->count[FRAME_SLOT_MISSED]++;
+        this->sequence++;
+        this->timed = false;
+        return;
+    }
+
+    // the host numbers every frame it sends, READ and WRITE
+    if (this->started && header->sequence != (uint8_t)(this->sequence + 1))
+    {
+        this->count[FRAME_SLOT_MISSED] += (uint8_t)(header->sequence - this->sequence - 1);
+        this->timed = false;
+    }
+    this->sequence = header->sequence;
+    this->started = true;
+
+    if (header->header != PRU_WRITE) return;
+
+    interval = now - this->lastWrite;
+
+    if (this->timed && interval < MAX_INTERVAL)
+    {
+        if (this->meanInterval == 0)
+        {
+            this->meanInterval = interval << 4;
+        }
+
+        difference = (interval << 4) > this->meanInterval ? (interval << 4) - this->meanInterval : this->meanInterval - (interval << 4);
+        difference >>= 4;
+
+        // bin n holds differences of 2^(n-1) to 2^n - 1 us
+        for (bin = 0; difference && bin < FRAME_HIST_BINS - 1; bin++)
+        {
+            difference >>= 1;
+        }
+        this->count[bin]++;
+
+        // the last bin holds the outliers, they are kept out of the mean
+        if (bin < FRAME_HIST_BINS - 1)
+        {
+            this->meanInterval += ((int32_t)(interval << 4) - (int32_t)this->meanInterval) >> 4;
+        }
+    }
+
+    this->lastWrite = now;
+    this->timed = true;
+}
+
+
+uint32_t FrameTiming::getTimestamp()
+{
+    return this->lastWrite;
+}
+
+
+uint32_t FrameTiming::nextSlot()
+{
+    uint32_t word = ((uint32_t)this->slot << 24) | (this->count[this->slot] & FRAME_COUNT_MASK);
+
+    this->slot = (this->slot + 1) % FRAME_SLOTS;
+
+    return word;
+}
@@ -0,0 +1,36 @@
+#ifndef FRAMETIMING_H
+#define FRAMETIMING_H
+
+#include <cstdint>
+
+#include "configuration.h"
+#include "remora.h"
+
+// Arrival time statistics of the host's SPI frames, kept by RemoraComms in the chip select
+// interrupt and sent to the host in the timestamp and timing words of the feedback frame
+//
+// The interval between WRITE frames is the host servo period as the PRU sees it. Its difference
+// from the running mean interval goes into log2 bins, see remora.h. Frames missing from the
+// host's sequence and rejected frames count as missed, and an interval across them is left out
+
+class FrameTiming
+{
+    private:
+
+        uint32_t    lastWrite;              // us_ticker time of the last WRITE
+        uint32_t    meanInterval;           // running mean of the WRITE interval, 1/16 us
+        uint32_t    count[FRAME_SLOTS];     // histogram bins, then missed frames
+        uint8_t     sequence;               // host sequence number of the last frame
+        uint8_t     slot;                   // next slot sent
+        bool        started;                // a frame has been seen
+        bool        timed;                  // lastWrite starts the next interval
+
+    public:
+
+        FrameTiming();
+        void frame(uint32_t, const frameHeader_t*, bool);  // arrival time, header, accepted
+        uint32_t getTimestamp(void);
+        uint32_t nextSlot(void);                            // timing word for the next feedback frame
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "phaseLock.h"
+#include "configuration.h"
+
+#define LOCK_TIMEOUT    (PRU_BASEFREQ / 10)     // Base periods without a WRITE before the timer free runs
+
+
+PhaseLock::PhaseLock(TIM_TypeDef* timer) :
+	timer(timer),
+	reload(0),
+	frameCount(0),
+	newFrame(false),
+	ticks(LOCK_TIMEOUT + 1),
+	integral(0),
+	trim(0),
+	residue(0),
+	phaseError(0)
+{
+}
+
+
+uint32_t PhaseLock::capture()
+{
+	return this->timer->CNT;
+}
+
+
+void PhaseLock::frame(uint32_t count)
+{
+	// the Base thread preempts the chip select interrupt, so the count is in place before the flag
+	this->frameCount = count;
+	this->newFrame = true;
+}
+
+
+void PhaseLock::update()
+{
+	int32_t period, limit, step;
+
+	// pruTimer sets ARR when the thread starts
+	if (this->reload == 0) this->reload = this->timer->ARR;
+
+	period = this->reload + 1;
+	limit = (period << 16) / 64;			// the trim is kept within 1.5% of the period
+	this->ticks++;
+
+	if (this->newFrame)
+	{
+		this->newFrame = false;
+
+		// the count runs from 0 to ARR, so this is within half a period either way
+		this->phaseError = (int32_t)this->frameCount - period / 2;
+
+		if (this->ticks <= LOCK_TIMEOUT)
+		{
+			// a trim of one count moves the next frame by one count for every Base period in
+			// between. Take an eighth of the error out per frame, and integrate an eighth of that
+			// for the difference between the clocks
+			step = (this->phaseError << 16) / (int32_t)(8 * this->ticks);
+			this->integral += step / 8;
+
+			if (this->integral > limit) this->integral = limit;
+			if (this->integral < -limit) this->integral = -limit;
+
+			this->trim = step + this->integral;
+
+			if (this->trim > limit) this->trim = limit;
+			if (this->trim < -limit) this->trim = -limit;
+		}
+
+		this->ticks = 0;
+	}
+	else if (this->ticks > LOCK_TIMEOUT)
+	{
+		// no frames, free run at the nominal period
+		this->ticks = LOCK_TIMEOUT + 1;
+		this->integral = 0;
+		this->trim = 0;
+	}
+
+	// the whole counts of the trim, and the fraction dithered over the periods. ARR is preloaded,
+	// the new value takes effect at the next update
+	this->residue += (uint32_t)this->trim & 0xFFFF;
+	this->timer->ARR = this->reload + (this->trim >> 16) + (this->residue >> 16);
+	this->residue &= 0xFFFF;
+}
+
+
+int32_t PhaseLock::getPhaseError()
+{
+	return this->phaseError;
+}
+
+
+int32_t PhaseLock::getTrim()
+{
+	return this->trim;
+}
@@ -0,0 +1,43 @@
+#ifndef PHASELOCK_H
+#define PHASELOCK_H
+
+#include "mbed.h"
+#include "modules/module.h"
+
+// Software PLL that holds the host's WRITE frames at a fixed phase of the Base thread
+//
+// RemoraComms reads the Base timer count at each chip select edge and passes the count of an
+// accepted WRITE to frame(). Scheduled in the Base thread, update() compares it with the middle
+// of the period and trims the timer's ARR, a fraction of a count at a time by dithering, until
+// the Base period divides the host servo period. A command is then latched half a Base period
+// after it arrives, every time, rather than at a phase that drifts with the difference between
+// the two clocks. The lock needs the host jitter to stay below half a Base period, and without
+// frames the timer returns to its nominal period
+
+class PhaseLock : public Module
+{
+	private:
+
+		TIM_TypeDef*		timer;
+		uint32_t			reload;			// nominal ARR, as set by pruTimer
+		volatile uint32_t	frameCount;		// timer count at the last WRITE
+		volatile bool		newFrame;
+		uint32_t			ticks;			// Base periods since the last WRITE
+		int32_t				integral;		// 1/65536 timer counts
+		int32_t				trim;			// ARR trim, 1/65536 timer counts
+		uint32_t			residue;		// fraction of a count carried to the next period
+		int32_t				phaseError;		// frame phase from the middle of the period, timer counts
+
+	public:
+
+		PhaseLock(TIM_TypeDef*);
+
+		uint32_t capture(void);				// timer count now, from the chip select interrupt
+		void frame(uint32_t);				// timer count at an accepted WRITE
+		int32_t getPhaseError(void);
+		int32_t getTrim(void);				// 1/65536 timer counts
+
+		virtual void update(void);
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "remoraFrame.h"
+
+#include <cstring>
+
+
+void packFeedback(uint32_t* frame, volatile txData_t* txData, uint8_t sequence, uint8_t joints, uint8_t variables, uint32_t timestamp, uint32_t timing)
+{
+    frameHeader_t* header = (frameHeader_t*)frame;
+    uint32_t* word = frame + 2;
+    uint8_t* bits;
+    float value;
+
+    header->header = txData->header;
+    header->version = REMORA_FRAME_VERSION;
+    header->sequence = sequence;
+    header->joints = joints;
+    header->variables = variables;
+
+    for (int i = 0; i < joints; i++)
+    {
+        *word++ = txData->jointFeedback[i];
+    }
+
+    for (int i = 0; i < joints; i++)
+    {
+        *word++ = 0;
+    }
+
+    for (int i = 0; i < variables; i++)
+    {
+        value = txData->processVariable[i];
+        memcpy(word++, &value, sizeof(value));
+    }
+
+    bits = (uint8_t*)word++;
+    bits[0] = txData->inputs;
+    bits[1] = 0;
+    bits[2] = 0;
+    bits[3] = 0;
+
+    *word++ = timestamp;
+    *word++ = timing;
+
+    *word = frameCRC(frame, FRAME_WORDS(joints, variables) - 1);
+}
+
+
+bool checkCommand(const uint32_t* frame, uint8_t joints, uint8_t variables)
+{
+    const frameHeader_t* header = (const frameHeader_t*)frame;
+
+    if (header->version != REMORA_FRAME_VERSION) return false;
+    if (header->joints != joints || header->variables != variables) return false;
+    if (frameCRC(frame, FRAME_WORDS(joints, variables) - 1) != frame[FRAME_WORDS(joints, variables) - 1]) return false;
+
+    return true;
+}
+
+
+void unpackCommand(const uint32_t* frame, volatile rxData_t* rxData, uint8_t joints, uint8_t variables)
+{
+    const frameHeader_t* header = (const frameHeader_t*)frame;
+    const uint32_t* word = frame + 2;
+    const uint8_t* bits;
+    float value;
+
+    rxData->header = header->header;
+
+    for (int i = 0; i < joints; i++)
+    {
+        rxData->jointFreqCmd[i] = *word++;
+    }
+
+    for (int i = 0; i < joints; i++)
+    {
+        rxData->jointPosCmd[i] = *word++;
+    }
+
+    for (int i = 0; i < variables; i++)
+    {
+        memcpy(&value, word++, sizeof(value));
+        rxData->setPoint[i] = value;
+    }
+
+    bits = (const uint8_t*)word;
+    rxData->jointEnable = bits[0];
+    rxData->outputs = bits[1];
+}
\ No newline at end of file
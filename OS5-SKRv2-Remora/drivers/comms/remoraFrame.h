@@ -0,0 +1,18 @@
+#ifndef REMORAFRAME_H
+#define REMORAFRAME_H
+
+#include <cstdint>
+
+#include "configuration.h"
+#include "remora.h"
+
+// Packing of rxData and txData to and from the SPI frame described in remora.h. Frames are
+// word aligned buffers of FRAME_WORDS(joints, variables) words
+
+uint32_t frameCRC(const uint32_t*, uint32_t);       // CRC-32 of a number of words, defined by the target's RemoraComms
+
+void packFeedback(uint32_t*, volatile txData_t*, uint8_t, uint8_t, uint8_t, uint32_t, uint32_t);  // frame, data, sequence, joints, variables, timestamp, timing
+bool checkCommand(const uint32_t*, uint8_t, uint8_t);                           // false if the version, layout or CRC is wrong
+void unpackCommand(const uint32_t*, volatile rxData_t*, uint8_t, uint8_t);      // a frame that passed checkCommand
+
+#endif
@@ -11,6 +11,9 @@
 extern JsonObject module;
 
 extern volatile bool PRUreset;
+extern volatile bool commandTimeout;     // no command from the host for 1.5 periods, set by CommandLatch
+extern volatile uint32_t commandTicks;   // Base ticks since the last command, 0 in the tick it is latched
+extern volatile uint32_t commandInterval; // Base ticks between the last two commands, 0 until measured
 
 // unions for RX and TX data
 extern volatile rxData_t rxData;
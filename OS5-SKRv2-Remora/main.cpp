@@ -18,7 +18,11 @@
 
 // drivers
 #include "RemoraComms.h"
+#include "commandLatch.h"
+#include "phaseLock.h"
 #include "pin.h"
+#include "timerClaim.h"
+#include "adcScan.h"
 
 // threads
 #include "irqHandlers.h"
@@ -28,20 +32,9 @@
 
 // modules
 #include "modules/module.h"
-#include "modules/blink/blink.h"
+#include "modules/loadModules.h"
+#include "modules/stepgenDMA/stepgenDMA.h"
 #include "modules/debug/debug.h"
-#include "modules/digitalPin/digitalPin.h"
-#include "modules/encoder/encoder.h"
-#include "modules/eStop/eStop.h"
-#include "modules/motorPower/motorPower.h"
-#include "modules/pwm/pwm.h"
-#include "modules/rcservo/rcservo.h"
-#include "modules/resetPin/resetPin.h"
-#include "modules/stepgen/stepgen.h"
-#include "modules/switch/switch.h"
-#include "modules/temperature/temperature.h"
-#include "modules/tmcStepper/tmcStepper.h"
-#include "qei.h"
 
 
 /***********************************************************************
@@ -60,9 +53,13 @@ enum State {
 };
 
 uint8_t resetCnt;
+uint16_t statsCnt;
 
 // boolean
 volatile bool PRUreset;
+volatile bool commandTimeout;
+volatile uint32_t commandTicks;
+volatile uint32_t commandInterval;
 bool configError = false;
 bool threadsRunning = false;
 
@@ -75,6 +72,7 @@ volatile txData_t txData;
 pruThread* baseThread;
 pruThread* servoThread;
 pruThread* commsThread;
+PhaseLock* phaseLock;
 
 // pointers to data
 volatile rxData_t*  ptrRxData = &rxData;
@@ -110,8 +108,6 @@ Watchdog& watchdog = Watchdog::get_instance();
 // Json configuration file stuff
 FILE *jsonFile;
 string strJson;
-DynamicJsonDocument doc(JSON_BUFF_SIZE);
-JsonObject module;
 
 
 /***********************************************************************
@@ -177,9 +173,15 @@ void setup()
     blockDevice.deinit();
     #endif
 
-    // initialise the Remora comms 
+    // initialise the Remora comms, it is started once the frame layout is known
     comms.init();
-    comms.start();
+
+    // the timers of the threads and the mbed us_ticker, claimed ahead of the modules. The probe
+    // captures on a channel of TIM9, so the Base thread only claims its counter
+    claimTimer(TIM5, "us_ticker");
+    claimTimer(TIM9, "Base thread", 1000000 / PRU_BASEFREQ);
+    claimTimer(TIM10, "Servo thread");
+    claimTimer(TIM11, "Comms thread");
 
     // Create the thread objects and set the interrupt vectors to RAM. This is needed
     // as we are using the SD bootloader that requires a different code starting
@@ -193,6 +195,17 @@ void setup()
     NVIC_SetVector(TIM1_UP_TIM10_IRQn, (uint32_t)TIM10_IRQHandler);
     NVIC_SetPriority(TIM1_UP_TIM10_IRQn, 3);
 
+    // WRITE frames are moved to rxData by the Base thread, ahead of every module and between
+    // Servo thread ticks
+    baseThread->scheduleModule(new CommandLatch(comms, servoThread));
+
+    #if PHASE_LOCK
+    // hold the WRITE frames half a Base period ahead of the tick that latches them
+    phaseLock = new PhaseLock(TIM9);
+    baseThread->scheduleModule(phaseLock);
+    comms.setPhaseLock(phaseLock);
+    #endif
+
     commsThread = new pruThread(TIM11, TIM1_TRG_COM_TIM11_IRQn, PRU_COMMSFREQ);
     NVIC_SetVector(TIM1_TRG_COM_TIM11_IRQn, (uint32_t)TIM11_IRQHandler);
     NVIC_SetPriority(TIM1_TRG_COM_TIM11_IRQn, 4);
@@ -204,127 +217,22 @@ void setup()
 
     // Other interrupt sources
 
+    // step DMA refills, only enabled when a DMA Stepgen is configured. Behind the Base thread,
+    // a refill has a whole block period to complete
+    NVIC_SetVector(DMA2_Stream2_IRQn, (uint32_t)DMA2_Stream2_IRQHandler);
+    NVIC_SetPriority(DMA2_Stream2_IRQn, 3);
+
 }
 
 
-void loadModules()
+void printThreadStats()
 {
-    printf("\n3. Parsing json configuration file\n");
-
-    const char *json = strJson.c_str();
-
-    // parse the json configuration file
-    DeserializationError error = deserializeJson(doc, json);
-
-    printf("Config deserialisation - ");
-
-    switch (error.code())
-    {
-        case DeserializationError::Ok:
-            printf("Deserialization succeeded\n");
-            break;
-        case DeserializationError::InvalidInput:
-            printf("Invalid input!\n");
-            configError = true;
-            break;
-        case DeserializationError::NoMemory:
-            printf("Not enough memory\n");
-            configError = true;
-            break;
-        default:
-            printf("Deserialization failed\n");
-            configError = true;
-            break;
-    }
-
-    if (configError) return;
-
-    printf("\n4. Loading modules\n");
-
-    JsonArray Modules = doc["Modules"];
-
-    // create objects from json data
-    for (JsonArray::iterator it=Modules.begin(); it!=Modules.end(); ++it)
-    {
-        module = *it;
-        
-        const char* thread = module["Thread"];
-        const char* type = module["Type"];
-
-        if (!strcmp(thread,"Base"))
-        {
-            printf("\nBase thread object\n");
-
-            if (!strcmp(type,"Stepgen"))
-            {
-                createStepgen();
-            }
-            else if (!strcmp(type,"Encoder"))
-            {
-                createEncoder();
-            }
-            else if (!strcmp(type,"RCServo"))
-            {
-                createRCServo();
-            }
-        }
-        else if (!strcmp(thread,"Servo"))
-        {
-            printf("\nServo thread object\n");
-
-            if (!strcmp(type, "eStop"))
-            {
-                createEStop();
-            }
-            else if (!strcmp(type, "Reset Pin"))
-            {
-                createResetPin();
-            }
-            else if (!strcmp(type, "Blink"))
-            {
-                createBlink();
-            }
-            else if (!strcmp(type,"Digital Pin"))
-            {
-                createDigitalPin();
-            }
-            else if (!strcmp(type,"PWM"))
-            {
-                createPWM();
-            }
-            else if (!strcmp(type,"Temperature"))
-            { 
-                createTemperature();
-            }
-            else if (!strcmp(type,"Switch"))
-            {
-                createSwitch();
-            }
-            else if (!strcmp(type,"QEI"))
-            {
-                createQEI();
-            }
-        }
-        else if (!strcmp(thread,"On load"))
-        {
-            printf("\nOn load - run once module\n");
-
-            if (!strcmp(type,"Motor Power"))
-            {
-                createMotorPower();
-            }
-            else if (!strcmp(type,"TMC2208 stepper"))
-            {
-                createTMC2208();
-            }
-            else if (!strcmp(type,"TMC2209 stepper"))
-            {
-                createTMC2209();
-            }
-        }
-    }
+    // DWT cycle count statistics collected by the threads since the last report
+    baseThread->printStats("Base");
+    servoThread->printStats("Servo");
 }
 
+
 void debugThreadHigh()
 {
     Module* debugOnS = new Debug("PE_5", 1);
@@ -387,9 +295,18 @@ int main()
             setup();
 
             //debugThreadHigh();
-            loadModules();
+            configError = !loadModules(strJson.c_str());
             //debugThreadLow();
 
+            // size the SPI frame for the loaded modules, the first frame armed already has this layout
+            {
+                uint8_t joints, variables;
+
+                getFrameLayout(joints, variables);
+                comms.setLayout(joints, variables);
+                comms.start();
+            }
+
             currentState = ST_START;
             break; 
 
@@ -410,6 +327,9 @@ int main()
                 printf("\nStarting the SERVO thread\n");
                 servoThread->startThread();
 
+                // the DMA Stepgen runs on TIM8, its DMA is set up here rather than in a thread interrupt
+                if (stepgenDMA != NULL) stepgenDMA->start();
+
                 threadsRunning = true;
 
                 // wait for threads to read IO before testing for PRUreset
@@ -544,6 +464,15 @@ int main()
             break;
       }
 
+    // an ADC overrun stops the thermistor scan, it is restarted here rather than in a thread
+    if (adcScan != NULL) adcScan->service();
+
+    if (threadsRunning && (++statsCnt >= STATS_TIME))
+    {
+        statsCnt = 0;
+        printThreadStats();
+    }
+
     wait(LOOP_TIME);
     }
 }
@@ -0,0 +1,24 @@
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <cstdint>
+
+#include "configuration.h"
+
+// An encoder module whose count another module can read directly
+//
+// The float PV is exact only up to 2^24 counts, and holds the index count while the index output
+// pulses. A PRU loop on an encoder reads the count here instead. getCount() gives the low 32
+// bits, so it is read in one access and a loop in the Servo thread never sees half of a Base
+// thread update. The count wraps like the Stepgen DDS accumulator.
+
+class Counter
+{
+	public:
+
+		virtual int32_t getCount(void) = 0;
+};
+
+extern Counter* counters[VARIABLES];	// by the PV[i] the count is also reported to, NULL for none
+
+#endif
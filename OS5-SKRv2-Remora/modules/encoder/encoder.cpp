@@ -1,5 +1,8 @@
 #include "encoder.h"
 
+ModuleBatch<Encoder>* encoderBatch = NULL;
+Counter* counters[VARIABLES];
+
 /***********************************************************************
                 MODULE CONFIGURATION AND CREATION FROM JSON     
 ************************************************************************/
@@ -14,6 +17,7 @@ void createEncoder()
     const char* pinI = module["Index Pin"];
     int dataBit = module["Data Bit"];
     const char* modifier = module["Modifier"];
+    int velocityPv = module["Velocity PV[i]"] | -1;     // optional
 
     printf("Creating Quadrature Encoder at pins %s and %s\n", pinA, pinB);
 
@@ -43,17 +47,30 @@ void createEncoder()
     ptrProcessVariable[pv]  = &txData.processVariable[pv];
     ptrInputs = &txData.inputs;
 
+    Encoder* encoder;
+
     if (pinI == nullptr)
     {
-        Module* encoder = new Encoder(*ptrProcessVariable[pv], pinA, pinB, mod);
-        baseThread->registerModule(encoder);
+        encoder = new Encoder(*ptrProcessVariable[pv], pinA, pinB, mod);
     }
     else
     {
         printf("  Encoder has index at pin %s\n", pinI);
-        Module* encoder = new Encoder(*ptrProcessVariable[pv], *ptrInputs, dataBit, pinA, pinB, pinI, mod);
-        baseThread->registerModule(encoder);
+        encoder = new Encoder(*ptrProcessVariable[pv], *ptrInputs, dataBit, pinA, pinB, pinI, mod);
+    }
+
+    if (velocityPv >= 0)
+    {
+        printf("  Encoder velocity to PV[%d]\n", velocityPv);
+        ptrProcessVariable[velocityPv] = &txData.processVariable[velocityPv];
+        encoder->setVelocity(*ptrProcessVariable[velocityPv]);
     }
+
+    counters[pv] = encoder;
+
+    // add to the encoder batch, registered in the Base thread once all the modules are loaded
+    if (encoderBatch == NULL) encoderBatch = new ModuleBatch<Encoder>();
+    encoderBatch->add(encoder);
 }
 
 /***********************************************************************
@@ -70,6 +87,7 @@ Encoder::Encoder(volatile float &ptrEncoderCount, std::string ChA, std::string C
     this->pinB = new Pin(this->ChB, INPUT, this->modifier);			// create Pin
     this->hasIndex = false;
 	this->count = 0;								                // initialise the count to 0
+    this->velocity = NULL;
 }
 
 Encoder::Encoder(volatile float &ptrEncoderCount, volatile uint8_t &ptrData, int bitNumber, std::string ChA, std::string ChB, std::string Index, int modifier) :
@@ -90,6 +108,19 @@ Encoder::Encoder(volatile float &ptrEncoderCount, volatile uint8_t &ptrData, int
 	this->count = 0;								                // initialise the count to 0
     this->pulseCount = 0;                                           // number of base thread periods to pulse the index output    
     this->mask = 1 << this->bitNumber;
+    this->velocity = NULL;
+}
+
+void Encoder::setVelocity(volatile float &ptrVelocity)
+{
+    // measured over at least a servo period, slower than 1 count/s reads as 0
+    this->ptrVelocity = &ptrVelocity;
+    this->velocity = new VelocityEstimator(PRU_BASEFREQ, PRU_BASEFREQ / PRU_SERVOFREQ, PRU_BASEFREQ);
+}
+
+int32_t Encoder::getCount()
+{
+    return this->count;
 }
 
 void Encoder::update()
@@ -138,6 +169,12 @@ void Encoder::update()
     {
         *(this->ptrEncoderCount) = this->count;             // update encoder count
     }
+
+    if (this->velocity != NULL)
+    {
+        this->velocity->update(this->count);
+        *(this->ptrVelocity) = this->velocity->get();
+    }
 }
 
 
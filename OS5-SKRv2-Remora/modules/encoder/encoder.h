@@ -7,13 +7,16 @@
 
 #include "configuration.h"
 #include "modules/module.h"
+#include "modules/moduleBatch.h"
 #include "drivers/pin/pin.h"
+#include "velocityEstimator.h"
+#include "counter.h"
 
 #include "extern.h"
 
 void createEncoder(void);
 
-class Encoder : public Module
+class Encoder : public Module, public Counter
 {
 
 	private:
@@ -28,6 +31,8 @@ class Encoder : public Module
         int mask;
 
 		volatile float *ptrEncoderCount; 	// pointer to the data source
+		volatile float *ptrVelocity;		// counts/s, when a Velocity PV is configured
+		VelocityEstimator* velocity;
 
         int8_t  modifier;
         uint8_t state;
@@ -45,7 +50,12 @@ class Encoder : public Module
 		Encoder(volatile float&, std::string, std::string, int);
         Encoder(volatile float&, volatile uint8_t&, int, std::string, std::string, std::string, int);
 
+		void setVelocity(volatile float&);	// report the velocity to a second PV
+		virtual int32_t getCount(void);
+
 		virtual void update(void);	// Module default interface
 };
 
+extern ModuleBatch<Encoder>* encoderBatch;   // all the encoders, scheduled as one batch in the Base thread
+
 #endif
@@ -0,0 +1,67 @@
+#include "velocityEstimator.h"
+
+
+VelocityEstimator::VelocityEstimator(uint32_t threadFreq, uint32_t minTicks, uint32_t maxTicks) :
+	minTicks(minTicks ? minTicks : 1),
+	maxTicks(maxTicks),
+	ticks(0),
+	windowCount(0),
+	lastCount(0),
+	stopped(true),
+	measured(0),
+	velocity(0)
+{
+	this->tickTime = 1.0f / (float)threadFreq;
+}
+
+
+void VelocityEstimator::update(uint32_t count)
+{
+	int32_t counts;
+	float limit;
+
+	if (this->ticks < this->maxTicks) this->ticks++;
+
+	if (count != this->lastCount)
+	{
+		this->lastCount = count;
+
+		if (this->stopped)
+		{
+			// the time since the last edge is unknown, measure from this one
+			this->stopped = false;
+			this->windowCount = count;
+			this->ticks = 0;
+		}
+		else if (this->ticks >= this->minTicks)
+		{
+			this->measured = (float)(int32_t)(count - this->windowCount) / ((float)this->ticks * this->tickTime);
+			this->velocity = this->measured;
+			this->windowCount = count;
+			this->ticks = 0;
+		}
+
+		return;
+	}
+
+	if (this->stopped) return;
+
+	if (this->ticks >= this->maxTicks)
+	{
+		this->stopped = true;
+		this->measured = 0;
+		this->velocity = 0;
+		return;
+	}
+
+	if (this->measured == 0) return;
+
+	// no change yet, so the encoder is slower than one more count over the window so far
+	counts = (int32_t)(count - this->windowCount);
+	if (counts < 0) counts = -counts;
+	limit = (float)(counts + 1) / ((float)this->ticks * this->tickTime);
+
+	if (this->measured > limit) this->velocity = limit;
+	else if (this->measured < -limit) this->velocity = -limit;
+	else this->velocity = this->measured;
+}
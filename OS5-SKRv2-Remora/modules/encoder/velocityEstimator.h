@@ -0,0 +1,46 @@
+#ifndef VELOCITYESTIMATOR_H
+#define VELOCITYESTIMATOR_H
+
+#include <cstdint>
+
+// Encoder velocity by the M/T method at the resolution of the thread tick, counts over the
+// ticks between the first and last edge of a window
+//
+// update() is called every thread tick with the count, and the ticks are the time base, as a
+// count change is only seen at a tick. A measuring window starts at a count change and closes
+// at the first change after the minimum window, so the time is always a whole number of edges.
+// At low speed that is the time between two edges to the nearest tick. At high speed, with a
+// change every tick, it becomes the count difference over the window. Between edges the
+// velocity is held, but no higher than one more count would allow, so it falls to 0 as 1/t
+// when the encoder stops, and reads 0 after the timeout.
+//
+// The edges are only timed to the tick that sees them, so each end of a window is up to one tick
+// late and the window is out by less than a tick either way. With the 25 us ticks of a 40 kHz
+// Base thread, that is up to +-2.5 % of a reading over the shortest window of a 1 ms servo
+// period, and a 5 % spread between readings of a steady speed, less over longer windows. This is
+// not 1/T with edges stamped by a free running clock. The Encoder polls its pins in the thread,
+// so it only sees an edge at a tick, and the QEI's timer counts the encoder rather than time.
+
+class VelocityEstimator
+{
+	private:
+
+		float		tickTime;			// s
+		uint32_t	minTicks;			// shortest window
+		uint32_t	maxTicks;			// longest time without a count change before the velocity is 0
+		uint32_t	ticks;				// since the start of the window
+		uint32_t	windowCount;		// count at the start of the window
+		uint32_t	lastCount;
+		bool		stopped;			// no window running, the next change starts one
+		float		measured;			// counts/s over the last window
+		float		velocity;			// counts/s
+
+	public:
+
+		VelocityEstimator(uint32_t, uint32_t, uint32_t);	// thread frequency, shortest window and timeout in ticks
+
+		void update(uint32_t);			// count, wrapping
+		inline float get() { return this->velocity; }
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "configuration.h"
+#include "remora.h"
+
+// libraries
+#include "ArduinoJson.h"
+
+#include "loadModules.h"
+#include "extern.h"
+
+// modules
+#include "modules/module.h"
+#include "modules/digitalPin/digitalPin.h"
+#include "modules/encoder/encoder.h"
+#include "modules/eStop/eStop.h"
+#include "modules/blink/blink.h"
+#include "modules/motorPower/motorPower.h"
+#include "modules/positionLoop/positionLoop.h"
+#include "modules/pwm/pwm.h"
+#include "modules/rcservo/rcservo.h"
+#include "modules/resetPin/resetPin.h"
+#include "modules/stepgen/stepgen.h"
+#include "modules/stepgen/stepgenBank.h"
+#include "modules/stepgenDMA/stepgenDMA.h"
+#include "modules/switch/switch.h"
+#include "modules/temperature/temperature.h"
+
+#if defined TARGET_STM32F4
+#include "modules/tmcStepper/tmcStepper.h"
+#include "qei.h"
+#include "probe.h"
+#endif
+
+
+/***********************************************************************
+        STRUCTURES AND GLOBAL VARIABLES
+************************************************************************/
+
+// Json configuration file stuff
+DynamicJsonDocument doc(JSON_BUFF_SIZE);
+JsonObject module;
+
+
+/***********************************************************************
+        ROUTINES
+************************************************************************/
+
+bool loadModules(const char* json)
+{
+    bool configError = false;
+
+    printf("\n3. Parsing json configuration file\n");
+
+    // parse the json configuration file
+    DeserializationError error = deserializeJson(doc, json);
+
+    printf("Config deserialisation - ");
+
+    switch (error.code())
+    {
+        case DeserializationError::Ok:
+            printf("Deserialization succeeded\n");
+            break;
+        case DeserializationError::InvalidInput:
+            printf("Invalid input!\n");
+            configError = true;
+            break;
+        case DeserializationError::NoMemory:
+            printf("Not enough memory\n");
+            configError = true;
+            break;
+        default:
+            printf("Deserialization failed\n");
+            configError = true;
+            break;
+    }
+
+    if (configError) return false;
+
+    printf("\n4. Loading modules\n");
+
+    JsonArray Modules = doc["Modules"];
+
+    // create objects from json data
+    for (JsonArray::iterator it=Modules.begin(); it!=Modules.end(); ++it)
+    {
+        module = *it;
+
+        const char* thread = module["Thread"];
+        const char* type = module["Type"];
+
+        if (!strcmp(thread,"Base"))
+        {
+            printf("\nBase thread object\n");
+
+            if (!strcmp(type,"Stepgen"))
+            {
+                createStepgen();
+            }
+            else if (!strcmp(type,"DMA Stepgen"))
+            {
+                createStepgenDMA();
+            }
+            else if (!strcmp(type,"Encoder"))
+            {
+                createEncoder();
+            }
+            else if (!strcmp(type,"RCServo"))
+            {
+                createRCServo();
+            }
+            else if (!strcmp(type,"Position Loop"))
+            {
+                createPositionLoop();
+            }
+#if defined TARGET_STM32F4
+            else if (!strcmp(type,"Probe"))
+            {
+                createProbe();
+            }
+#endif
+        }
+        else if (!strcmp(thread,"Servo"))
+        {
+            printf("\nServo thread object\n");
+
+            if (!strcmp(type, "eStop"))
+            {
+                createEStop();
+            }
+            else if (!strcmp(type, "Reset Pin"))
+            {
+                createResetPin();
+            }
+            else if (!strcmp(type, "Blink"))
+            {
+                createBlink();
+            }
+            else if (!strcmp(type,"Digital Pin"))
+            {
+                createDigitalPin();
+            }
+            else if (!strcmp(type,"PWM"))
+            {
+                createPWM();
+            }
+            else if (!strcmp(type,"Temperature"))
+            {
+                createTemperature();
+            }
+            else if (!strcmp(type,"Switch"))
+            {
+                createSwitch();
+            }
+            else if (!strcmp(type,"Position Loop"))
+            {
+                createPositionLoop();
+            }
+#if defined TARGET_STM32F4
+            else if (!strcmp(type,"QEI"))
+            {
+                createQEI();
+            }
+#endif
+        }
+        else if (!strcmp(thread,"On load"))
+        {
+            printf("\nOn load - run once module\n");
+
+            if (!strcmp(type,"Motor Power"))
+            {
+                createMotorPower();
+            }
+#if defined TARGET_STM32F4
+            else if (!strcmp(type,"TMC2208 stepper"))
+            {
+                createTMC2208();
+            }
+            else if (!strcmp(type,"TMC2209 stepper"))
+            {
+                createTMC2209();
+            }
+#endif
+        }
+    }
+
+    // compile the Base thread schedule: the per-joint modules run as flat, type specialised
+    // batches, all the Stepgens then all the Encoders, ahead of the remaining modules
+    if (stepgenBank != NULL) baseThread->scheduleModule(stepgenBank);
+    if (encoderBatch != NULL) baseThread->scheduleModule(encoderBatch);
+
+    return true;
+}
+
+
+void getFrameLayout(uint8_t &joints, uint8_t &variables)
+{
+    // the SPI frame carries every joint and variable up to the highest one a module uses
+    joints = 0;
+    variables = 0;
+
+    for (int i = 0; i < JOINTS; i++)
+    {
+        if (ptrJointFreqCmd[i] != NULL) joints = i + 1;
+    }
+
+    for (int i = 0; i < VARIABLES; i++)
+    {
+        if (ptrSetPoint[i] != NULL || ptrProcessVariable[i] != NULL) variables = i + 1;
+    }
+}
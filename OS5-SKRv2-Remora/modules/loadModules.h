@@ -0,0 +1,12 @@
+#ifndef LOADMODULES_H
+#define LOADMODULES_H
+
+#include <cstdint>
+
+// Parse the json configuration and create the Modules it describes. Kept out of main.cpp
+// so the same loader can be driven by the host simulation build (TARGET_SIM)
+
+bool loadModules(const char*);    // returns false if the json configuration could not be parsed
+void getFrameLayout(uint8_t&, uint8_t&);   // joints and variables used by the loaded modules, for the SPI frame
+
+#endif
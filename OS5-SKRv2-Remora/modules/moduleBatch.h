@@ -0,0 +1,49 @@
+#ifndef MODULEBATCH_H
+#define MODULEBATCH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "modules/module.h"
+
+// A contiguous batch of modules of one type
+//
+// The batch is registered in a thread as a single Module. Each tick it runs every member with a
+// qualified, non-virtual call to T::update(), so the thread makes one virtual call for the whole
+// batch instead of one runModule() and one virtual update() per module. Only use this for
+// modules that run every thread cycle, as a member's slowUpdate() is not called.
+
+template <class T>
+class ModuleBatch : public Module
+{
+	private:
+
+		std::vector<T*> batch;
+
+	public:
+
+		void add(T* module)
+		{
+			this->batch.push_back(module);
+		}
+
+		size_t size(void)
+		{
+			return this->batch.size();
+		}
+
+		T* operator[](size_t i)
+		{
+			return this->batch[i];
+		}
+
+		virtual void update(void)
+		{
+			T** module = this->batch.data();
+			T** end = module + this->batch.size();
+
+			for (; module != end; ++module) (*module)->T::update();
+		}
+};
+
+#endif
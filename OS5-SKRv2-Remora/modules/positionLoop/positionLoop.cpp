@@ -0,0 +1,127 @@
+#include "positionLoop.h"
+#include "modules/stepgen/stepgenBank.h"
+
+#include <cmath>
+
+/***********************************************************************
+                MODULE CONFIGURATION AND CREATION FROM JSON
+************************************************************************/
+
+void createPositionLoop()
+{
+    const char* comment = module["Comment"];
+    printf("%s\n",comment);
+
+    const char* thread = module["Thread"];
+    int joint = module["Joint Number"];
+    int pv = module["PV[i]"];
+    float stepsPerCount = module["Steps Per Count"];
+    float pGain = module["P Gain"];
+    float iGain = module["I Gain"];
+    float deadband = module["Deadband"];
+    float maxCorrection = module["Max Correction"];
+
+    Stepgen* stepgen = NULL;
+
+    if (stepsPerCount == 0) stepsPerCount = 1.0;
+    if (maxCorrection == 0) maxCorrection = PRU_BASEFREQ / 2;
+
+    // the joint's Stepgen must be configured ahead of the position loop
+    for (size_t i = 0; stepgenBank != NULL && i < stepgenBank->size(); i++)
+    {
+        if ((*stepgenBank)[i]->getJointNumber() == joint) stepgen = (*stepgenBank)[i];
+    }
+
+    if (stepgen == NULL)
+    {
+        printf("No Stepgen for joint %d, position loop not created\n", joint);
+        return;
+    }
+
+    // and so must the encoder
+    if (pv < 0 || pv >= VARIABLES || counters[pv] == NULL)
+    {
+        printf("No encoder on PV[%d], position loop not created\n", pv);
+        return;
+    }
+
+    printf("Creating position loop for joint %d from the encoder on PV[%d]\n", joint, pv);
+
+    if (!strcmp(thread,"Base"))
+    {
+        Module* loop = new PositionLoop(stepgen, counters[pv], PRU_BASEFREQ, stepsPerCount, pGain, iGain, deadband, maxCorrection);
+        baseThread->registerModule(loop);
+    }
+    else
+    {
+        Module* loop = new PositionLoop(stepgen, counters[pv], PRU_SERVOFREQ, stepsPerCount, pGain, iGain, deadband, maxCorrection);
+        servoThread->registerModule(loop);
+    }
+}
+
+
+/***********************************************************************
+                METHOD DEFINITIONS
+************************************************************************/
+
+PositionLoop::PositionLoop(Stepgen* stepgen, Counter* encoder, int32_t threadFreq, float stepsPerCount, float pGain, float iGain, float deadband, float maxCorrection) :
+	stepgen(stepgen),
+	encoder(encoder),
+	pGain(pGain),
+	iGain(iGain),
+	deadband(deadband),
+	maxCorrection(maxCorrection)
+{
+	this->stepsPerCount = (int32_t)(stepsPerCount * 65536.0f + 0.5f);
+	this->shift = this->stepgen->getStepBit() - 16;
+	this->stepScale = 1.0f / (float)(1L << this->stepgen->getStepBit());
+	this->period = 1.0f / (float)threadFreq;
+	this->wasEnabled = false;
+	this->offset = 0;
+	this->integral = 0;
+}
+
+
+uint32_t PositionLoop::encoderPosition()
+{
+	// the encoder count scaled to DDS accumulator units, wrapping the same way as the accumulator
+	int32_t count = this->encoder->getCount();
+
+	return (uint32_t)(((int64_t)count * this->stepsPerCount) << this->shift);
+}
+
+
+void PositionLoop::update()
+{
+	float error, correction;
+
+	if (!this->stepgen->getEnabled())
+	{
+		this->wasEnabled = false;
+		this->integral = 0;
+		this->stepgen->setCorrection(0);
+		return;
+	}
+
+	if (!this->wasEnabled)
+	{
+		// start from no error, so enabling the joint does not move it
+		this->offset = this->encoderPosition() - (uint32_t)this->stepgen->getCommandPosition();
+		this->wasEnabled = true;
+	}
+
+	// following error in steps, the difference is taken in the wrapping DDS units
+	error = (float)(int32_t)((uint32_t)this->stepgen->getCommandPosition() + this->offset - this->encoderPosition()) * this->stepScale;
+
+	if (fabsf(error) <= this->deadband) error = 0;
+
+	this->integral += this->iGain * error * this->period;
+	if (this->integral > this->maxCorrection) this->integral = this->maxCorrection;
+	if (this->integral < -this->maxCorrection) this->integral = -this->maxCorrection;
+
+	correction = this->pGain * error + this->integral;
+	if (correction > this->maxCorrection) correction = this->maxCorrection;
+	if (correction < -this->maxCorrection) correction = -this->maxCorrection;
+
+	this->stepgen->setCorrection((int32_t)correction);
+}
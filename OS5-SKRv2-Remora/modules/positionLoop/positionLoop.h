@@ -0,0 +1,53 @@
+#ifndef POSITIONLOOP_H
+#define POSITIONLOOP_H
+
+#include <cstdint>
+
+#include "modules/module.h"
+#include "modules/stepgen/stepgen.h"
+#include "modules/encoder/counter.h"
+
+#include "extern.h"
+
+void createPositionLoop(void);
+
+// Closed loop position control of a Stepgen joint on the PRU
+//
+// The host still sends a frequency command and sees the commanded step position as the joint
+// feedback. The loop compares that commanded position with the count of the Encoder or QEI
+// module reporting to PV[i], read from the module rather than the float PV, and adds a PI
+// correction to the Stepgen DDS. Lost steps and following error are then corrected at the
+// thread rate rather than a servo period late. The encoder is aligned to the commanded position
+// each time the joint is enabled.
+
+class PositionLoop : public Module
+{
+	private:
+
+		Stepgen*		stepgen;
+		Counter*		encoder;			// the encoder module the count is read from
+
+		int32_t			stepsPerCount;		// 16.16 fixed point
+		int				shift;				// from steps in 16.16 to DDS accumulator units
+		float			stepScale;			// steps per DDS accumulator unit
+
+		float			pGain;				// Hz per step of error
+		float			iGain;				// Hz per step second of error
+		float			deadband;			// steps
+		float			maxCorrection;		// Hz
+		float			period;				// s
+
+		bool			wasEnabled;
+		uint32_t		offset;				// encoder position at enable less the commanded position, DDS units
+		float			integral;			// Hz
+
+		uint32_t encoderPosition(void);
+
+	public:
+
+		PositionLoop(Stepgen*, Counter*, int32_t, float, float, float, float, float);
+
+		virtual void update(void);
+};
+
+#endif
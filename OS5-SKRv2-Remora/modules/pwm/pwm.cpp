@@ -1,5 +1,9 @@
 #include "pwm.h"
 
+#if defined TARGET_STM32F4
+#include "hardwarePwm.h"
+#endif
+
 #define PID_PWM_MAX 256		// 8 bit resolution
 
 /***********************************************************************
@@ -16,45 +20,59 @@ void createPWM()
     const char* pin = module["PWM Pin"];
 
     const char* hardware = module["Hardware PWM"];
-    const char* variable = module["Variable Freq"];
-    int period_sp = module["Period SP[i]"];
-    int period = module["Period us"];
 
     printf("Make PWM at pin %s\n", pin);
     
     ptrSetPoint[sp] = &rxData.setPoint[sp];
 
-    if (!strcmp(hardware,"True"))
+    if (hardware != nullptr && !strcmp(hardware,"True"))
     {
-        // Hardware PWM
-        if (!strcmp(variable,"True"))
+#if defined TARGET_STM32F4
+        // Hardware PWM, 1 kHz when no period is given
+        const char* variable = module["Variable Freq"];
+        int period_sp = module["Period SP[i]"];
+        int period = module["Period us"];
+        HardwarePWM* pwm;
+
+        if (period <= 0) period = 1000;
+
+        if (variable != nullptr && !strcmp(variable,"True"))
         {
             // Variable frequency hardware PWM
             ptrSetPoint[period_sp] = &rxData.setPoint[period_sp];
 
-            //Module* pwm = new HardwarePWM(*ptrSetPoint[period_sp], *ptrSetPoint[sp], period, pin);
-            //servoThread->registerModule(pwm);
+            pwm = new HardwarePWM(*ptrSetPoint[period_sp], *ptrSetPoint[sp], period, pin, pwmMax);
         }
         else
         {
             // Fixed frequency hardware PWM
-            //Module* pwm = new HardwarePWM(*ptrSetPoint[sp], period, pin);
-            //servoThread->registerModule(pwm);
-        }
-    }
-    else
-    {
-        // Software PWM
-        if (pwmMax != 0) // use configuration file value for pwmMax - useful for 12V on 24V systems
-        {
-            Module* pwm = new PWM(*ptrSetPoint[sp], pin, pwmMax);
-            servoThread->registerModule(pwm);
+            pwm = new HardwarePWM(*ptrSetPoint[sp], period, pin, pwmMax);
         }
-        else // use default value of pwmMax
+
+        if (!pwm->configPWM())
         {
-            Module* pwm = new PWM(*ptrSetPoint[sp], pin);
-            servoThread->registerModule(pwm);
+            printf("PWM not created, the PWM Pin must be a channel of a free timer\n");
+            delete pwm;
+            return;
         }
+
+        servoThread->registerModule(pwm);
+        return;
+#else
+        printf("No hardware PWM on this target, using software PWM\n");
+#endif
+    }
+
+    // Software PWM
+    if (pwmMax != 0) // use configuration file value for pwmMax - useful for 12V on 24V systems
+    {
+        Module* pwm = new PWM(*ptrSetPoint[sp], pin, pwmMax);
+        servoThread->registerModule(pwm);
+    }
+    else // use default value of pwmMax
+    {
+        Module* pwm = new PWM(*ptrSetPoint[sp], pin);
+        servoThread->registerModule(pwm);
     }
 }
 
@@ -1,5 +1,7 @@
 #include "stepgen.h"
+#include "stepgenBank.h"
 
+#include <cstring>
 
 /***********************************************************************
                 MODULE CONFIGURATION AND CREATION FROM JSON     
@@ -14,15 +16,33 @@ void createStepgen()
     const char* enable = module["Enable Pin"];
     const char* step = module["Step Pin"];
     const char* dir = module["Direction Pin"];
+    uint32_t stepLength = module["Step Length"];         // ns, optional
+    uint32_t dirSetup = module["Dir Setup"];             // ns, optional
+    uint32_t stopDecel = module["Comms Loss Decel"];     // steps/s^2, optional
+    const char* interpolation = module["Interpolation"]; // "Position", optional
 
     // configure pointers to data source and feedback location
     ptrJointFreqCmd[joint] = &rxData.jointFreqCmd[joint];
     ptrJointFeedback[joint] = &txData.jointFeedback[joint];
     ptrJointEnable = &rxData.jointEnable;
 
-    // create the step generator, register it in the thread
-    Module* stepgen = new Stepgen(PRU_BASEFREQ, joint, enable, step, dir, STEPBIT, *ptrJointFreqCmd[joint], *ptrJointFeedback[joint], *ptrJointEnable);
-    baseThread->registerModule(stepgen);
+    // create the step generator, add it to the stepgen bank. The bank is registered in the
+    // Base thread once all the modules are loaded
+    Stepgen* stepgen = new Stepgen(PRU_BASEFREQ, joint, enable, step, dir, STEPBIT, *ptrJointFreqCmd[joint], *ptrJointFeedback[joint], *ptrJointEnable);
+    stepgen->setTiming(stepLength, dirSetup);
+
+    // move to the host's position setpoint over each servo period, rather than run at the
+    // frequency command
+    if (interpolation != NULL && !strcmp(interpolation, "Position"))
+    {
+        stepgen->setInterpolation(&rxData.jointPosCmd[joint]);
+    }
+
+    // without one the joint runs on at the last command until the main loop resets the PRU
+    stepgen->setStopDecel(stopDecel);
+
+    if (stepgenBank == NULL) stepgenBank = new StepgenBank();
+    stepgenBank->add(stepgen);
 }
 
 
@@ -38,16 +58,30 @@ Stepgen::Stepgen(int32_t threadFreq, int jointNumber, std::string enable, std::s
 	stepBit(stepBit),
 	ptrFrequencyCommand(&ptrFrequencyCommand),
 	ptrFeedback(&ptrFeedback),
+	ptrPositionCommand(NULL),
 	ptrJointEnable(&ptrJointEnable)
 {
 	this->enablePin = new Pin(this->enable, OUTPUT);			// create Pins
 	this->stepPin = new Pin(this->step, OUTPUT);
 	this->directionPin = new Pin(this->direction, OUTPUT);
 	this->DDSaccumulator = 0;
-	this->frequencyScale = (float)(1 << this->stepBit) / (float)threadFreq;
+	this->commandPosition = 0;
+	this->DDScorrection = 0;
+	this->frequencyScale = (((uint64_t)1 << (this->stepBit + 16)) + threadFreq / 2) / threadFreq;
+	this->frequencyCommand = 0;
+	this->DDSaddValue = 0;
+	this->maxAddValue = 1 << (this->stepBit - 1);
+	this->stopStep = 0;
+	this->stopping = false;
+	this->threadFreq = threadFreq;
 	this->mask = 1 << this->jointNumber;
 	this->isEnabled = false;
 	this->isForward = false;
+	this->isStepping = false;
+	this->directionOut = false;
+	this->stepLength = 0;
+	this->dirSetup = 0;
+	this->directionPin->set(false);
 }
 
 
@@ -64,38 +98,30 @@ void Stepgen::slowUpdate()
 
 void Stepgen::makePulses()
 {
-	int32_t stepNow = 0;
-
-	this->isEnabled = ((*(this->ptrJointEnable) & this->mask) != 0);
+	this->updateDDS();
 
 	if (this->isEnabled == true)  												// this Step generator is enables so make the pulses
 	{
 		this->enablePin->set(false);                                			// Enable the driver - CHANGE THIS TO MAKE THE OUTPUT VALUE CONFIGURABLE???
 
-		this->frequencyCommand = *(this->ptrFrequencyCommand);            		// Get the latest frequency command via pointer to the data source
-		this->DDSaddValue = this->frequencyCommand * this->frequencyScale;		// Scale the frequency command to get the DDS add value
-		stepNow = this->DDSaccumulator;                           				// Save the current DDS accumulator value
-		this->DDSaccumulator += this->DDSaddValue;           	  				// Update the DDS accumulator with the new add value
-		stepNow ^= this->DDSaccumulator;                          				// Test for changes in the low half of the DDS accumulator
-		stepNow &= (1L << this->stepBit);                         				// Check for the step bit
-		this->rawCount = this->DDSaccumulator >> this->stepBit;   				// Update the position raw count
-
-		if (this->DDSaddValue > 0)												// The sign of the DDS add value indicates the desired direction
-		{
-			this->isForward = true;
-		}
-		else //if (this->DDSaddValue < 0)
+		if (this->isStepping)
 		{
-			this->isForward = false;
-		}
+			if (this->isForward != this->directionOut)
+			{
+				this->directionPin->set(this->isForward);             	// Set direction pin
+				this->directionOut = this->isForward;
+				waitCycles(this->dirSetup);
+			}
 
-		if (stepNow)
-		{
-			this->directionPin->set(this->isForward);             		// Set direction pin
 			this->stepPin->set(true);										// Raise step pin - A4988 / DRV8825 stepper drivers only need 200ns setup time
-			*(this->ptrFeedback) = this->DDSaccumulator;                     // Update position feedback via pointer to the data receiver
+
+			if (this->stepLength)
+			{
+				waitCycles(this->stepLength);								// the pulse ends in this thread cycle, so a step can be made every cycle
+				this->stepPin->set(false);
+			}
 		}
-		else
+		else if (!this->stepLength)
 		{
 			this->stepPin->set(false);										// Reset step pin
 		}
@@ -108,7 +134,116 @@ void Stepgen::makePulses()
 
 }
 
+void Stepgen::updateDDS()
+{
+	int32_t stepNow = 0;
+	int32_t command, addValue, remaining;
+
+	this->isEnabled = ((*(this->ptrJointEnable) & this->mask) != 0);
+	this->isStepping = false;
+
+	if (this->isEnabled == true)
+	{
+		if (commandTimeout && this->stopStep)
+		{
+			// the host has gone quiet, ramp down to a stop
+			this->stopping = true;
+
+			if (this->DDSaddValue > this->stopStep) this->DDSaddValue -= this->stopStep;
+			else if (this->DDSaddValue < -this->stopStep) this->DDSaddValue += this->stopStep;
+			else this->DDSaddValue = 0;
+		}
+		else if (this->ptrPositionCommand != NULL && commandInterval && commandTicks < commandInterval)
+		{
+			// reach the setpoint when the next command is due. The difference is taken in 32 bits
+			// so it wraps with the position. The frequency command is marked as taken, so past a
+			// late command the rate that was reaching the setpoint runs on
+			remaining = commandInterval - commandTicks;
+			addValue = (int32_t)((uint32_t)*(this->ptrPositionCommand) - (uint32_t)this->commandPosition) / remaining;
+			if (addValue > this->maxAddValue) addValue = this->maxAddValue;
+			else if (addValue < -this->maxAddValue) addValue = -this->maxAddValue;
+			this->DDSaddValue = addValue;
+			this->frequencyCommand = *(this->ptrFrequencyCommand);
+			this->stopping = false;
+		}
+		else
+		{
+			command = *(this->ptrFrequencyCommand);            					// Get the latest frequency command via pointer to the data source
+
+			if (command != this->frequencyCommand || this->stopping)			// The command only changes once per SPI packet
+			{
+				this->frequencyCommand = command;
+				this->stopping = false;
+				addValue = ((int64_t)command * this->frequencyScale + 0x8000) >> 16;	// Scale the frequency command to get the DDS add value
+				if (addValue > this->maxAddValue) addValue = this->maxAddValue;		// Faster would cross several steps in a tick
+				else if (addValue < -this->maxAddValue) addValue = -this->maxAddValue;
+				this->DDSaddValue = addValue;
+			}
+		}
+
+		addValue = this->DDSaddValue + this->DDScorrection;						// The position loop correction only moves the output
+		if (addValue > this->maxAddValue) addValue = this->maxAddValue;
+		else if (addValue < -this->maxAddValue) addValue = -this->maxAddValue;
+
+		stepNow = this->DDSaccumulator;                           				// Save the current DDS accumulator value
+		this->DDSaccumulator += addValue;           	  						// Update the DDS accumulator with the new add value
+		this->commandPosition += this->DDSaddValue;
+		stepNow ^= this->DDSaccumulator;                          				// Test for changes in the low half of the DDS accumulator
+		stepNow &= (1L << this->stepBit);                         				// Check for the step bit
+		this->rawCount = this->DDSaccumulator >> this->stepBit;   				// Update the position raw count
+		*(this->ptrFeedback) = this->commandPosition;							// Update position feedback every tick, a step can come from the correction alone
+
+		if (stepNow)
+		{
+			this->isStepping = true;
+			this->isForward = (addValue > 0);									// The sign of the DDS add value indicates the direction of the step
+		}
+	}
+}
+
 void Stepgen::setEnabled(bool state)
 {
 	this->isEnabled = state;
 }
+
+void Stepgen::setCorrection(int32_t frequency)
+{
+	this->DDScorrection = ((int64_t)frequency * this->frequencyScale + 0x8000) >> 16;
+}
+
+void Stepgen::setStopDecel(uint32_t decel)
+{
+	// the frequency falls by decel / threadFreq each tick, at least one add value count so the
+	// ramp always ends
+	this->stopStep = 0;
+	if (decel == 0) return;
+
+	this->stopStep = ((uint64_t)decel * this->frequencyScale / this->threadFreq + 0x8000) >> 16;
+	if (this->stopStep < 1) this->stopStep = 1;
+}
+
+void Stepgen::setInterpolation(volatile int32_t* positionCommand)
+{
+	this->ptrPositionCommand = positionCommand;
+}
+
+void Stepgen::setTiming(uint32_t stepLength, uint32_t dirSetup)
+{
+	uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+	uint32_t maxTime = 500000000 / this->threadFreq;		// ns, half the thread period
+
+	// both are busy waits in the thread's interrupt, so together they are held to half the thread
+	// period and leave the rest for the other modules. The Step Length is kept first
+	if ((uint64_t)stepLength + dirSetup > maxTime)
+	{
+		if (stepLength > maxTime) stepLength = maxTime;
+		dirSetup = maxTime - stepLength;
+		printf("  Step Length and Dir Setup held to %lu and %lu ns, together half the thread period\n", (unsigned long)stepLength, (unsigned long)dirSetup);
+	}
+
+	this->stepLength = (stepLength * cyclesPerUs + 999) / 1000;
+	this->dirSetup = (dirSetup * cyclesPerUs + 999) / 1000;
+
+	// a pulse that ends within the tick leaves the next tick free for a step
+	this->maxAddValue = this->stepLength ? (1 << this->stepBit) : (1 << (this->stepBit - 1));
+}
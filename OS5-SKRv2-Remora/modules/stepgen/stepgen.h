@@ -12,6 +12,14 @@
 
 void createStepgen(void);
 
+// busy wait on the DWT cycle counter, for pulse timing within a thread cycle
+inline void waitCycles(uint32_t cycles)
+{
+    uint32_t start = DWT->CYCCNT;
+
+    while ((DWT->CYCCNT - start) < cycles);
+}
+
 class Stepgen : public Module
 {
   private:
@@ -23,16 +31,28 @@ class Stepgen : public Module
 
     bool isEnabled;        	// flag to enable the step generator
     bool isForward;        	// current diretion
+    bool isStepping;        // a step is due this thread cycle
+    bool directionOut;      // state of the direction pin
+
+    uint32_t stepLength;    // step pulse width in DWT cycles, 0 holds the step high until the next thread cycle
+    uint32_t dirSetup;      // direction setup time in DWT cycles before a step after a direction change
 
     int32_t frequencyCommand;     	// the joint frequency command generated by LinuxCNC
     volatile int32_t *ptrFrequencyCommand; 	// pointer to the data source where to get the frequency command
     int32_t rawCount;             	// current position raw count - not currently used - mirrors original stepgen.c
     volatile int32_t *ptrFeedback;       	// pointer where to put the feedback
+    volatile int32_t *ptrPositionCommand;   // the host's position setpoint to interpolate to, NULL to follow the frequency command
     volatile uint8_t *ptrJointEnable;
     int32_t DDSaccumulator;       	// Direct Digital Synthesis (DDS) accumulator
-    float   frequencyScale;		  	  // frequency scale
+    int32_t commandPosition;        // DDS accumulator without the position loop correction, reported to the host
+    int32_t DDScorrection;          // add value from a PRU position loop, 0 when open loop
+    uint32_t frequencyScale;		  // DDS add value per Hz, 16.16 fixed point
   	int32_t	DDSaddValue;		  	    // DDS accumulator add vdd value
     int32_t stepBit;                // position in the DDS accumulator that triggers a step pulse
+    int32_t maxAddValue;            // one step every tick with a Step Length, every second tick without
+
+    int32_t stopStep;               // add value change per tick when stopping on a command timeout, 0 runs on
+    bool stopping;                  // stopped on a command timeout, the next command is taken as new
 
   public:
 
@@ -43,8 +63,24 @@ class Stepgen : public Module
     virtual void update(void);           // Module default interface
     virtual void slowUpdate(void);
     void makePulses();
+    void updateDDS();                    // update the DDS accumulator without writing to the pins
     void setEnabled(bool);
-};
+    void setTiming(uint32_t, uint32_t);  // step length and direction setup in ns, together at most half the thread period
+    void setCorrection(int32_t);         // position loop correction in Hz, added to the frequency command
+    void setStopDecel(uint32_t);         // deceleration to a stop on a command timeout in steps/s^2, 0 runs on
+    void setInterpolation(volatile int32_t*);   // position setpoint in DDS counts, NULL for none
 
+    inline int getJointNumber() { return this->jointNumber; }
+    inline int getStepBit() { return this->stepBit; }
+    inline int32_t getCommandPosition() { return this->commandPosition; }
+    inline int32_t getAddValue() { return this->DDSaddValue; }     // added to the command position this tick
+
+    inline bool getEnabled() { return this->isEnabled; }
+    inline bool getForward() { return this->isForward; }
+    inline bool getStepping() { return this->isStepping; }
+    inline uint32_t getStepLength() { return this->stepLength; }
+    inline uint32_t getDirSetup() { return this->dirSetup; }
+    inline uint32_t getMaxWait() { return SystemCoreClock / this->threadFreq / 2; }   // Step Length and Dir Setup together, in DWT cycles
+};
 
 #endif
@@ -0,0 +1,156 @@
+#include "stepgenBank.h"
+
+
+StepgenBank* stepgenBank = NULL;
+
+
+/***********************************************************************
+                METHOD DEFINITIONS
+************************************************************************/
+
+StepgenBank::StepgenBank() :
+	stepLength(0),
+	dirSetup(0)
+{
+}
+
+
+uint8_t StepgenBank::portIndex(GPIO_TypeDef* port)
+{
+	port_t entry;
+
+	for (size_t i = 0; i < this->ports.size(); i++)
+	{
+		if (this->ports[i].port == port) return i;
+	}
+
+	entry.port = port;
+	entry.dirEnBSRR = 0;
+	entry.stepBSRR = 0;
+	this->ports.push_back(entry);
+
+	return this->ports.size() - 1;
+}
+
+
+void StepgenBank::add(Stepgen* stepgen)
+{
+	joint_t joint;
+
+	joint.stepgen = stepgen;
+	joint.stepPort = this->portIndex(stepgen->stepPin->getPort());
+	joint.stepMask = stepgen->stepPin->getPin();
+	joint.dirPort = this->portIndex(stepgen->directionPin->getPort());
+	joint.dirMask = stepgen->directionPin->getPin();
+	joint.enablePort = this->portIndex(stepgen->enablePin->getPort());
+	joint.enableMask = stepgen->enablePin->getPin();
+	joint.directionOut = false;
+
+	if (stepgen->getStepLength() > this->stepLength) this->stepLength = stepgen->getStepLength();
+	if (stepgen->getDirSetup() > this->dirSetup) this->dirSetup = stepgen->getDirSetup();
+
+	// the longest of each are taken from different joints, so they are held together again
+	if (this->stepLength + this->dirSetup > stepgen->getMaxWait())
+	{
+		this->dirSetup = stepgen->getMaxWait() - this->stepLength;
+		printf("  Dir Setup of the Stepgens held to %lu ns, with the longest Step Length half the thread period\n",
+			(unsigned long)(this->dirSetup * 1000 / (SystemCoreClock / 1000000)));
+	}
+
+	this->joints.push_back(joint);
+}
+
+
+size_t StepgenBank::size(void)
+{
+	return this->joints.size();
+}
+
+
+Stepgen* StepgenBank::operator[](size_t i)
+{
+	return this->joints[i].stepgen;
+}
+
+
+void StepgenBank::update()
+{
+	port_t* port;
+	port_t* portEnd = this->ports.data() + this->ports.size();
+	joint_t* joint = this->joints.data();
+	joint_t* jointEnd = joint + this->joints.size();
+	bool dirChange = false;
+	bool stepping = false;
+
+	for (port = this->ports.data(); port != portEnd; ++port)
+	{
+		port->dirEnBSRR = 0;
+		port->stepBSRR = 0;
+	}
+
+	// update the DDS of every joint and collect the pin changes, the upper half of BSRR resets a pin
+	for (; joint != jointEnd; ++joint)
+	{
+		Stepgen* stepgen = joint->stepgen;
+
+		stepgen->updateDDS();
+
+		if (stepgen->getEnabled())
+		{
+			this->ports[joint->enablePort].dirEnBSRR |= (uint32_t)joint->enableMask << 16;		// enable is active low
+
+			if (stepgen->getStepping())
+			{
+				if (stepgen->getForward())
+				{
+					this->ports[joint->dirPort].dirEnBSRR |= joint->dirMask;
+				}
+				else
+				{
+					this->ports[joint->dirPort].dirEnBSRR |= (uint32_t)joint->dirMask << 16;
+				}
+
+				if (stepgen->getForward() != joint->directionOut)
+				{
+					joint->directionOut = stepgen->getForward();
+					dirChange = true;
+				}
+
+				this->ports[joint->stepPort].stepBSRR |= joint->stepMask;
+				stepping = true;
+			}
+			else if (!this->stepLength)
+			{
+				this->ports[joint->stepPort].stepBSRR |= (uint32_t)joint->stepMask << 16;
+			}
+		}
+		else
+		{
+			this->ports[joint->enablePort].dirEnBSRR |= joint->enableMask;
+		}
+	}
+
+	// direction and enable first, then one store per port for the step pins
+	for (port = this->ports.data(); port != portEnd; ++port)
+	{
+		if (port->dirEnBSRR) port->port->BSRR = port->dirEnBSRR;
+	}
+
+	if (dirChange) waitCycles(this->dirSetup);
+
+	for (port = this->ports.data(); port != portEnd; ++port)
+	{
+		if (port->stepBSRR) port->port->BSRR = port->stepBSRR;
+	}
+
+	// end the pulses in this tick, so a step can be made on every tick
+	if (this->stepLength && stepping)
+	{
+		waitCycles(this->stepLength);
+
+		for (port = this->ports.data(); port != portEnd; ++port)
+		{
+			if (port->stepBSRR) port->port->BSRR = (port->stepBSRR & 0xFFFF) << 16;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef STEPGENBANK_H
+#define STEPGENBANK_H
+
+#include <cstdint>
+#include <vector>
+
+#include "stm32f4xx_hal.h"
+
+#include "modules/module.h"
+#include "stepgen.h"
+
+// All the step generators, run as one module in the Base thread
+//
+// Each Stepgen only updates its DDS. The bank then builds one BSRR word per GPIO port and
+// writes the direction and enable bits first and the step bits second, so every step pin on a
+// port changes with a single store and the direction is always set up ahead of the step edge.
+// With a Step Length the step pins are reset again in the same tick, after the longest Step
+// Length of the joints, and a change of direction waits for the longest Dir Setup. The two
+// together are held to half the thread period, as each Stepgen's own are.
+
+class StepgenBank : public Module
+{
+	private:
+
+		typedef struct
+		{
+			GPIO_TypeDef*	port;
+			uint32_t		dirEnBSRR;		// direction and enable bits for this tick
+			uint32_t		stepBSRR;		// step bits for this tick
+		} port_t;
+
+		typedef struct
+		{
+			Stepgen*		stepgen;
+			uint8_t			stepPort, dirPort, enablePort;	// index into ports
+			uint16_t		stepMask, dirMask, enableMask;	// GPIO_PIN_x masks
+			bool			directionOut;					// state of the direction pin
+		} joint_t;
+
+		std::vector<port_t>		ports;
+		std::vector<joint_t>	joints;
+
+		uint32_t				stepLength;		// longest Step Length and Dir Setup of the joints, in DWT cycles
+		uint32_t				dirSetup;
+
+		uint8_t portIndex(GPIO_TypeDef*);
+
+	public:
+
+		StepgenBank();
+
+		void add(Stepgen*);
+		size_t size(void);
+		Stepgen* operator[](size_t);
+
+		virtual void update(void);
+};
+
+extern StepgenBank* stepgenBank;
+
+#endif
@@ -0,0 +1,230 @@
+#include "stepgenDMA.h"
+
+#include <cstring>
+
+
+StepgenDMA* stepgenDMA = NULL;
+
+/***********************************************************************
+                MODULE CONFIGURATION AND CREATION FROM JSON
+************************************************************************/
+
+void createStepgenDMA()
+{
+    const char* comment = module["Comment"];
+    printf("%s\n",comment);
+
+    int joint = module["Joint Number"];
+    const char* enable = module["Enable Pin"];
+    const char* step = module["Step Pin"];
+    const char* dir = module["Direction Pin"];
+    uint32_t stopDecel = module["Comms Loss Decel"];     // steps/s^2, optional
+
+    // configure pointers to data source and feedback location
+    ptrJointFreqCmd[joint] = &rxData.jointFreqCmd[joint];
+    ptrJointFeedback[joint] = &txData.jointFeedback[joint];
+    ptrJointEnable = &rxData.jointEnable;
+
+    // all the DMA joints share one module, registered in the Servo thread to latch the enables
+    // and start the DMA along with the threads
+    if (stepgenDMA == NULL)
+    {
+        if (!StepDMA::claim())
+        {
+            printf("DMA Stepgen: joint %d not created, TIM8 is in use by another module\n", joint);
+            return;
+        }
+
+        stepgenDMA = new StepgenDMA(*ptrJointEnable);
+        servoThread->registerModule(stepgenDMA);
+    }
+
+    if (!stepgenDMA->add(joint, enable, step, dir, *ptrJointFreqCmd[joint], *ptrJointFeedback[joint], stopDecel))
+    {
+        printf("DMA Stepgen: joint %d not created, the Step and Direction pins must share a port and at most %d ports can be used\n", joint, DMA_STREAMS);
+    }
+}
+
+
+/***********************************************************************
+                METHOD DEFINITIONS
+************************************************************************/
+
+StepgenDMA::StepgenDMA(volatile uint8_t &ptrJointEnable) :
+	ptrJointEnable(&ptrJointEnable),
+	jointEnable(0),
+	running(false)
+{
+	this->dma = new StepDMA(PRU_DMAFREQ, PRU_DMAFREQ / PRU_SERVOFREQ, this);
+	this->frequencyScale = (((uint64_t)1 << (STEPBIT + 16)) + PRU_DMAFREQ / 2) / PRU_DMAFREQ;
+	this->maxAddValue = 1 << (STEPBIT - 1);							// one step every second word
+}
+
+
+bool StepgenDMA::add(int jointNumber, std::string enable, std::string step, std::string direction, volatile int32_t &ptrFrequencyCommand, volatile int32_t &ptrFeedback, uint32_t stopDecel)
+{
+	joint_t joint;
+	int8_t stream;
+
+	joint.stepPin = new Pin(step, OUTPUT);
+	joint.directionPin = new Pin(direction, OUTPUT);
+	joint.enablePin = new Pin(enable, OUTPUT);
+	joint.enablePin->set(true);										// disabled, enable is active low
+
+	if (joint.stepPin->getPort() != joint.directionPin->getPort()) return false;
+
+	stream = this->dma->addPort(joint.stepPin->getPort());
+	if (stream < 0) return false;
+
+	joint.jointNumber = jointNumber;
+	joint.mask = 1 << jointNumber;
+	joint.stream = stream;
+	joint.stepMask = joint.stepPin->getPin();
+	joint.dirMask = joint.directionPin->getPin();
+	joint.isForward = false;
+	joint.stepPending = false;
+	joint.DDSaccumulator = 0;
+	joint.frequencyCommand = 0;
+	joint.DDSaddValue = 0;
+	joint.stopping = false;
+	joint.ptrFrequencyCommand = &ptrFrequencyCommand;
+	joint.ptrFeedback = &ptrFeedback;
+
+	// the add value is stepped down once a block, at least one count so the ramp always ends
+	joint.stopStep = 0;
+	if (stopDecel)
+	{
+		joint.stopStep = ((uint64_t)stopDecel * this->dma->getBlockSize() * this->frequencyScale / PRU_DMAFREQ + 0x8000) >> 16;
+		if (joint.stopStep < 1) joint.stopStep = 1;
+	}
+
+	joint.directionPin->set(false);
+	joint.stepPin->set(false);
+
+	this->joints.push_back(joint);
+
+	return true;
+}
+
+
+void StepgenDMA::start()
+{
+	if (this->running) return;
+
+	this->dma->start();
+	this->running = true;
+}
+
+
+void StepgenDMA::update()
+{
+	this->jointEnable = *(this->ptrJointEnable);
+
+	for (size_t i = 0; i < this->joints.size(); i++)
+	{
+		this->joints[i].enablePin->set((this->jointEnable & this->joints[i].mask) == 0);
+	}
+}
+
+
+void StepgenDMA::fillBlock(uint8_t block)
+{
+	const uint32_t blockSize = this->dma->getBlockSize();
+	const uint32_t stepMask = (1UL << STEPBIT) - 1;
+	joint_t* joint = this->joints.data();
+	joint_t* end = joint + this->joints.size();
+
+	for (uint8_t i = 0; i < this->dma->getStreams(); i++)
+	{
+		memset(this->dma->getBuffer(i) + block * blockSize, 0, blockSize * sizeof(uint32_t));	// a zero BSRR word leaves the port unchanged
+	}
+
+	for (; joint != end; ++joint)
+	{
+		uint32_t* w = this->dma->getBuffer(joint->stream) + block * blockSize;
+		uint32_t acc = joint->DDSaccumulator;
+		uint32_t slot = 0;
+		uint32_t add, distance, k;
+		int32_t addValue;
+		bool forward;
+
+		// feedback is the position at the start of this block, when the block before it has played
+		*(joint->ptrFeedback) = acc;
+
+		// finish a step pulse left high at the end of the last block
+		if (joint->stepPending)
+		{
+			w[0] |= joint->stepMask << 16;
+			joint->stepPending = false;
+		}
+
+		if ((this->jointEnable & joint->mask) == 0) continue;
+
+		if (commandTimeout && joint->stopStep)
+		{
+			// the host has gone quiet, ramp down to a stop
+			joint->stopping = true;
+
+			if (joint->DDSaddValue > joint->stopStep) joint->DDSaddValue -= joint->stopStep;
+			else if (joint->DDSaddValue < -joint->stopStep) joint->DDSaddValue += joint->stopStep;
+			else joint->DDSaddValue = 0;
+		}
+		else
+		{
+			// only scale the command when it has changed
+			addValue = *(joint->ptrFrequencyCommand);
+
+			if (addValue != joint->frequencyCommand || joint->stopping)
+			{
+				joint->frequencyCommand = addValue;
+				joint->stopping = false;
+				addValue = ((int64_t)addValue * this->frequencyScale + 0x8000) >> 16;
+				if (addValue > this->maxAddValue) addValue = this->maxAddValue;
+				else if (addValue < -this->maxAddValue) addValue = -this->maxAddValue;
+				joint->DDSaddValue = addValue;
+			}
+		}
+
+		addValue = joint->DDSaddValue;
+
+		if (addValue == 0) continue;
+
+		forward = (addValue > 0);
+		add = forward ? addValue : -addValue;
+
+		// a direction change takes the first word of the block, the DDS starts one word later so
+		// the direction is set up ahead of the first step
+		if (forward != joint->isForward)
+		{
+			w[0] |= forward ? joint->dirMask : joint->dirMask << 16;
+			joint->isForward = forward;
+			slot = 1;
+		}
+
+		// jump from step to step, k is the number of words until the accumulator next crosses a step boundary
+		while (true)
+		{
+			distance = forward ? ((1UL << STEPBIT) - (acc & stepMask)) : ((acc & stepMask) + 1);
+			k = (distance + add - 1) / add;
+
+			if (slot + k > blockSize)
+			{
+				acc += forward ? (blockSize - slot) * add : -((blockSize - slot) * add);
+				break;
+			}
+
+			slot += k;
+			acc += forward ? k * add : -(k * add);
+
+			w[slot - 1] |= joint->stepMask;							// step high in the word of the crossing
+			if (slot < blockSize) w[slot] |= joint->stepMask << 16;	// and low in the next
+			else joint->stepPending = true;
+		}
+
+		joint->DDSaccumulator = acc;
+	}
+
+	// the feedback was written outside the threads, so a frame packed part way through this
+	// interrupt is packed again
+	pruThread::nextGeneration();
+}
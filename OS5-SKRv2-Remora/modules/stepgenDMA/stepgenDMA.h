@@ -0,0 +1,68 @@
+#ifndef STEPGENDMA_H
+#define STEPGENDMA_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "modules/module.h"
+#include "drivers/pin/pin.h"
+#include "drivers/stepDMA/stepDMA.h"
+
+#include "extern.h"
+
+void createStepgenDMA(void);
+
+// Step generators played out by timer triggered DMA
+//
+// The joints use the same frequency command and DDS feedback as Stepgen, but the DDS runs at
+// PRU_DMAFREQ. Each block of BSRR words is computed in one go from the DDS add value, so the
+// cost is per step and per block rather than per thread tick, and step rates up to
+// PRU_DMAFREQ/2 are possible. The Step and Direction pins of a joint must be on the same port,
+// and the joints can use at most DMA_STREAMS ports between them.
+
+class StepgenDMA : public Module
+{
+	private:
+
+		typedef struct
+		{
+			int				jointNumber;
+			uint8_t			mask;
+			uint8_t			stream;				// DMA stream (port) of the step and direction pins
+			uint32_t		stepMask;			// GPIO_PIN_x masks
+			uint32_t		dirMask;
+			bool			isForward;			// direction pin state in the blocks already filled
+			bool			stepPending;		// the step pin is high at the end of the last block
+			uint32_t		DDSaccumulator;
+			int32_t			frequencyCommand;	// command the add value was computed for
+			int32_t			DDSaddValue;
+			int32_t			stopStep;			// add value change per block on a command timeout, 0 runs on
+			bool			stopping;			// stopped on a command timeout, the next command is taken as new
+			volatile int32_t *ptrFrequencyCommand;
+			volatile int32_t *ptrFeedback;
+			Pin				*stepPin, *directionPin, *enablePin;
+		} joint_t;
+
+		std::vector<joint_t>	joints;
+		volatile uint8_t		*ptrJointEnable;
+		uint8_t					jointEnable;		// enable bits latched by the Servo thread
+		StepDMA*				dma;
+		bool					running;
+		uint32_t				frequencyScale;		// DDS add value per Hz, 16.16 fixed point
+		int32_t					maxAddValue;
+
+	public:
+
+		StepgenDMA(volatile uint8_t&);
+
+		bool add(int, std::string, std::string, std::string, volatile int32_t&, volatile int32_t&, uint32_t);	// last, the stop deceleration in steps/s^2
+		void fillBlock(uint8_t);				// called from the DMA interrupt with the block to refill
+		void start(void);						// from main() with the threads, not from an interrupt
+
+		virtual void update(void);
+};
+
+extern StepgenDMA* stepgenDMA;
+
+#endif
@@ -12,6 +12,7 @@ typedef union
   {
     int32_t header;
     volatile int32_t jointFreqCmd[JOINTS]; 	// Base thread commands ?? - basically motion
+    volatile int32_t jointPosCmd[JOINTS];   // position setpoint in DDS counts, for a Stepgen that interpolates
     float setPoint[VARIABLES];		  // Servo thread commands ?? - temperature SP, PWM etc
     uint8_t jointEnable;
     uint8_t outputs;
@@ -42,4 +43,51 @@ typedef union
 
 extern volatile txData_t txData;
 
+
+// SPI frame
+//
+// rxData and txData keep the full JOINTS and VARIABLES layout that the modules point into. On
+// the wire both directions use a packed frame holding only the joints and variables that the
+// configuration uses, so the frame size is agreed with the host from the layout descriptor:
+//
+//   int32_t    header                  PRU_READ, PRU_WRITE, PRU_DATA or PRU_ESTOP
+//   uint8_t    version                 REMORA_FRAME_VERSION
+//   uint8_t    sequence                incremented by the sender for every frame
+//   uint8_t    joints                  layout descriptor
+//   uint8_t    variables
+//   int32_t    joint[joints]           jointFreqCmd / jointFeedback
+//   int32_t    position[joints]        jointPosCmd / 0
+//   float      variable[variables]     setPoint / processVariable
+//   uint8_t    bits[4]                 jointEnable, outputs / inputs
+//   uint32_t   timestamp               0 / us_ticker time of the last WRITE received
+//   uint32_t   timing                  0 / one slot of the frame timing statistics
+//   uint32_t   crc                     CRC-32 of the preceding words, as the STM32 CRC unit
+//
+// A WRITE gives each joint a velocity in Hz and the position, in DDS counts wrapping at 32 bits
+// like the feedback, that the joint should reach when the next WRITE is due. The PRU sends 0 in
+// the position words, so both directions stay the same size.
+//
+// The timing word holds the slot number in the top byte and the low 24 bits of its count. One
+// slot goes out per frame, in turn. Slot n of the FRAME_HIST_BINS counts the WRITE intervals
+// that differ from the mean interval by 2^(n-1) to 2^n - 1 us, 0 us for slot 0, and the last
+// also counts larger differences. FRAME_SLOT_MISSED counts frames lost or rejected, see frameTiming.h
+
+#define REMORA_FRAME_VERSION    4
+#define FRAME_SIZE(j, v)        (24 + 4 * (2 * (j) + (v)))    // bytes, always a whole number of words
+#define FRAME_WORDS(j, v)       (FRAME_SIZE(j, v) / 4)
+
+#define FRAME_HIST_BINS         12
+#define FRAME_SLOT_MISSED       FRAME_HIST_BINS
+#define FRAME_SLOTS             (FRAME_HIST_BINS + 1)
+#define FRAME_COUNT_MASK        0x00FFFFFF
+
+typedef struct
+{
+    int32_t header;
+    uint8_t version;
+    uint8_t sequence;
+    uint8_t joints;
+    uint8_t variables;
+} frameHeader_t;
+
 #endif
@@ -12,14 +12,26 @@ Thermistor::Thermistor(std::string pin, float beta, int r0, int t0) :
 	this->k = (1.0F / (this->t0 + 273.15F));
 
 	this->thermistorPin = new Pin(this->pin, INPUT);
-	this->adc = new AnalogIn(this->thermistorPin->pinToPinName());
+	this->adc = NULL;
+
+	// scanned continuously by DMA, so a reading doesn't wait for a conversion
+	if (adcScan == NULL) adcScan = new AdcScan();
+	this->scanPlace = adcScan->addChannel(this->thermistorPin);
+
+	if (this->scanPlace < 0)
+	{
+		printf("  Pin %s can't be scanned, reading it by AnalogIn\n", this->pin.c_str());
+		this->adc = new AnalogIn(this->thermistorPin->pinToPinName());
+	}
 	this->r1 = 0;
 	this->r2 = 4700;
 }
 
-// Use AnalogIn to get ADC value
+// Latest ADC value from the scan, or from AnalogIn
 int Thermistor::newThermistorReading()
 {
+	if (this->scanPlace >= 0) return adcScan->read(this->scanPlace);
+
 	return this->adc->read_u16();
 }
 
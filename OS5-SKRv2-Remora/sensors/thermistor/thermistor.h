@@ -7,6 +7,7 @@
 //#include "FastAnalogIn.h"
 #include "sensors/tempSensor.h"
 #include "drivers/pin/pin.h"
+#include "drivers/adcScan/adcScan.h"
 
 // Derived class from Tempsensor
 
@@ -16,7 +17,8 @@ class Thermistor : public TempSensor
 
 		std::string pin;
 
-		AnalogIn *adc;
+		AnalogIn *adc;			// only for a pin the ADC scan can't take
+		int8_t scanPlace;		// in the ADC scan, -1 when read by AnalogIn
 
 		float temperatureMax, temperatureMin;
 		bool useSteinhartHart;
@@ -36,4 +36,9 @@ void Interrupt::TIM10_Wrapper(void)
 void Interrupt::TIM11_Wrapper(void)
 {
 	ISRVectorTable[TIM1_TRG_COM_TIM11_IRQn]->ISR_Handler();
+}
+
+void Interrupt::DMA2_Stream2_Wrapper(void)
+{
+	ISRVectorTable[DMA2_Stream2_IRQn]->ISR_Handler();
 }
\ No newline at end of file
@@ -24,6 +24,7 @@ class Interrupt
 		static void TIM9_Wrapper();
         static void TIM10_Wrapper();
         static void TIM11_Wrapper();
+        static void DMA2_Stream2_Wrapper();
 
 		virtual void ISR_Handler(void) = 0;
 
@@ -0,0 +1,184 @@
+#include "pruThread.h"
+#include "modules/module.h"
+
+#include <algorithm>
+
+
+using namespace std;
+
+static inline void recordCycles(cycleStats_t &stats, uint32_t cycles)
+{
+	if (cycles < stats.min) stats.min = cycles;
+	if (cycles > stats.max) stats.max = cycles;
+	stats.total += cycles;
+	stats.count++;
+}
+
+static void clearStats(cycleStats_t &stats)
+{
+	stats.min = UINT32_MAX;
+	stats.max = 0;
+	stats.total = 0;
+	stats.count = 0;
+}
+
+
+volatile uint32_t pruThread::generation = 0;
+
+
+// Thread constructor
+pruThread::pruThread(TIM_TypeDef* timer, IRQn_Type irq, uint32_t frequency) :
+	TimerPtr(NULL),
+	timer(timer),
+	irq(irq),
+	frequency(frequency),
+	scheduled(0),
+	running(false)
+{
+	printf("Creating thread %d\n", this->frequency);
+
+	// enable the DWT cycle counter used to time the threads
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	this->periodCycles = SystemCoreClock / this->frequency;
+	this->resetStats();
+}
+
+void pruThread::startThread(void)
+{
+	TimerPtr = new pruTimer(this->timer, this->irq, this->frequency, this);
+}
+
+void pruThread::stopThread(void)
+{
+    this->TimerPtr->stopTimer();
+}
+
+
+void pruThread::registerModule(Module* module)
+{
+	cycleStats_t stats;
+
+	clearStats(stats);
+	this->vThread.push_back(module);
+	this->moduleStats.push_back(stats);
+}
+
+
+void pruThread::scheduleModule(Module* module)
+{
+	cycleStats_t stats;
+
+	clearStats(stats);
+	this->vThread.insert(this->vThread.begin() + this->scheduled, module);
+	this->moduleStats.insert(this->moduleStats.begin() + this->scheduled, stats);
+	this->scheduled++;
+}
+
+
+void pruThread::unregisterModule(Module* module)
+{
+	for (size_t i = 0; i < this->vThread.size(); )
+	{
+		if (this->vThread[i] == module)
+		{
+			this->vThread.erase(this->vThread.begin() + i);
+			this->moduleStats.erase(this->moduleStats.begin() + i);
+			if (i < this->scheduled) this->scheduled--;
+		}
+		else ++i;
+	}
+}
+
+void pruThread::run(void)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint32_t moduleStart = start;
+	uint32_t now;
+
+	Module** module = this->vThread.data();
+	Module** end = module + this->vThread.size();
+	cycleStats_t* stats = this->moduleStats.data();
+
+	this->running = true;
+
+	// walk the contiguous module array to run all instances of Module::runModule()
+	for (; module != end; ++module, ++stats)
+	{
+		(*module)->runModule();
+
+		now = DWT->CYCCNT;
+		recordCycles(*stats, now - moduleStart);
+		moduleStart = now;
+	}
+
+	// a tick of a higher priority thread may be lost from the count, but the count still changes
+	this->running = false;
+	pruThread::generation++;
+
+	now = moduleStart - start;
+	recordCycles(this->threadStats, now);
+	if (now > this->periodCycles) this->overruns++;
+}
+
+
+bool pruThread::isRunning(void)
+{
+	return this->running;
+}
+
+
+uint32_t pruThread::getGeneration(void)
+{
+	return pruThread::generation;
+}
+
+
+void pruThread::nextGeneration(void)
+{
+	pruThread::generation++;
+}
+
+
+void pruThread::resetStats(void)
+{
+	this->overruns = 0;
+	clearStats(this->threadStats);
+
+	for (size_t i = 0; i < this->moduleStats.size(); i++)
+	{
+		clearStats(this->moduleStats[i]);
+	}
+}
+
+
+void pruThread::printStats(const char* name)
+{
+	cycleStats_t thread;
+	vector<cycleStats_t> modules;
+	uint32_t overrunCnt;
+
+	// take a consistent copy, the thread interrupt is only held off for the copy
+	if (this->TimerPtr != NULL) NVIC_DisableIRQ(this->irq);
+	thread = this->threadStats;
+	modules = this->moduleStats;
+	overrunCnt = this->overruns;
+	this->resetStats();
+	if (this->TimerPtr != NULL) NVIC_EnableIRQ(this->irq);
+
+	if (thread.count == 0) return;
+
+	printf("%s thread: %lu ticks, period %lu cycles, overruns %lu\n", name,
+		(unsigned long)thread.count, (unsigned long)this->periodCycles, (unsigned long)overrunCnt);
+	printf("  thread    min %5lu  max %5lu  mean %5lu cycles\n", (unsigned long)thread.min,
+		(unsigned long)thread.max, (unsigned long)(thread.total / thread.count));
+
+	for (size_t i = 0; i < modules.size(); i++)
+	{
+		if (modules[i].count == 0) continue;
+
+		printf("  module %2u min %5lu  max %5lu  mean %5lu cycles\n", (unsigned)i, (unsigned long)modules[i].min,
+			(unsigned long)modules[i].max, (unsigned long)(modules[i].total / modules[i].count));
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef PRUTHREAD_H
+#define PRUTHREAD_H
+
+#include "stm32f4xx_hal.h"
+#include "timer.h"
+
+// Standard Template Library (STL) includes
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+class Module;
+
+// execution time of the thread and its modules, in DWT core clock cycles
+typedef struct
+{
+	uint32_t			min;
+	uint32_t			max;
+	uint64_t			total;
+	uint32_t			count;
+} cycleStats_t;
+
+class pruThread
+{
+
+	private:
+
+		pruTimer* 		    TimerPtr;
+
+		TIM_TypeDef* 	    timer;
+		IRQn_Type 			irq;
+		uint32_t 			frequency;
+
+		vector<Module*> vThread;		// vector containing pointers to Thread modules
+		size_t			scheduled;		// number of modules placed at the front of vThread by scheduleModule()
+
+		volatile bool		running;		// true while run() is ticking the modules
+		static volatile uint32_t generation;	// changes with every tick of any thread, and every other write of txData
+
+		uint32_t			periodCycles;	// core clock cycles in one thread period
+		uint32_t			overruns;		// number of ticks that took longer than the thread period
+		cycleStats_t		threadStats;
+		vector<cycleStats_t> moduleStats;	// one entry per module in vThread
+
+	public:
+
+		pruThread(TIM_TypeDef* timer, IRQn_Type irq, uint32_t frequency);
+
+		void registerModule(Module *module);
+		void scheduleModule(Module *module);	// run ahead of the registered modules, in the order scheduled
+        void unregisterModule(Module *module);
+		void startThread(void);
+        void stopThread(void);
+		void run(void);
+		bool isRunning(void);
+		static uint32_t getGeneration(void);	// see RemoraComms::processPacket
+		static void nextGeneration(void);		// after an interrupt outside the threads has written txData
+
+		void printStats(const char*);	// report the timing statistics and start a new measurement window
+		void resetStats(void);
+};
+
+#endif
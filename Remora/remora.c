@@ -31,12 +31,6 @@
 #include <string.h>
 
 
-// Using BCM2835 driver library by Mike McCauley, why reinvent the wheel!
-// http://www.airspayce.com/mikem/bcm2835/index.html
-// Include these in the source directory when using "halcompile --install remora.c"
-#include "bcm2835.h"
-#include "bcm2835.c"
-
 #include "remora.h"
 
 //#define TARGET_LPC
@@ -45,6 +39,13 @@
 #define MODNAME "remora"
 #define PREFIX "remora"
 
+// SPI transports, see transport.h
+// Include these in the source directory when using "halcompile --install remora.c"
+#include "transport.h"
+#include "transport_bcm2835.c"
+#include "transport_spidev.c"
+#include "transport_loopback.c"
+
 MODULE_AUTHOR("Scott Alford AKA scotta");
 MODULE_DESCRIPTION("Driver for Remora LPC1768 control board");
 MODULE_LICENSE("GPL v2");
@@ -52,6 +53,18 @@ MODULE_LICENSE("GPL v2");
 char *ctrl_type[JOINTS] = { "p" };
 RTAPI_MP_ARRAY_STRING(ctrl_type,JOINTS,"control type (pos or vel)");
 
+char *transport = "bcm2835";
+RTAPI_MP_STRING(transport,"SPI transport (bcm2835, spidev or loopback)");
+
+char *spidev = "/dev/spidev0.0";
+RTAPI_MP_STRING(spidev,"spidev device for the spidev transport");
+
+int spi_speed = 25000000;
+RTAPI_MP_INT(spi_speed,"SPI clock in Hz for the spidev transport");
+
+char *reset_gpio = "";
+RTAPI_MP_STRING(reset_gpio,"sysfs GPIO value file for the PRU reset with the spidev transport");
+
 /***********************************************************************
 *                STRUCTURES AND GLOBAL VARIABLES                       *
 ************************************************************************/
@@ -62,6 +75,11 @@ typedef struct {
 	hal_bit_t		*PRUreset;
 	bool			SPIresetOld;
 	hal_bit_t		*SPIstatus;
+	hal_u32_t		*SPIseqErrors;				// pin: PRU frames missed or repeated, from the frame sequence numbers
+	hal_u32_t		*SPIframeTime;				// pin: PRU time of the last WRITE it received (us)
+	hal_u32_t		*SPIframeInterval;			// pin: PRU time between the last two WRITEs (us)
+	hal_u32_t		*SPIjitter[FRAME_HIST_BINS];	// pin: WRITE intervals per log2 bin of difference from the mean
+	hal_u32_t		*SPImissed;					// pin: frames the PRU lost or rejected
 	hal_bit_t 		*stepperEnable[JOINTS];
 	int				pos_mode[JOINTS];
 	hal_float_t 	*pos_cmd[JOINTS];			// pin: position command (position units)
@@ -70,18 +88,35 @@ typedef struct {
 	hal_s32_t		*count[JOINTS];				// pin: psition feedback (raw counts)
 	hal_float_t 	pos_scale[JOINTS];			// param: steps per position unit
 	float 			freq[JOINTS];				// param: frequency command sent to PRU
+	int64_t			pos_target[JOINTS];			// position setpoint sent to PRU, DDS counts
+	double			target_freq[JOINTS];		// step rate of the position setpoint (Hz)
 	hal_float_t 	*freq_cmd[JOINTS];			// pin: frequency command monitoring, available in LinuxCNC
 	hal_float_t 	maxvel[JOINTS];				// param: max velocity, (pos units/sec)
+	hal_float_t 	maxfreq[JOINTS];			// param: max step rate of the PRU step generator (Hz)
 	hal_float_t 	maxaccel[JOINTS];			// param: max accel (pos units/sec^2)
 	hal_float_t		*pgain[JOINTS];
 	hal_float_t		*ff1gain[JOINTS];
+	hal_float_t		*ff2gain[JOINTS];			// pin: acceleration feedforward (sec), 0 for none
+	hal_float_t		*cmd_filter[JOINTS];		// pin: command derivative filter cutoff (Hz), 0 for none
+	hal_float_t		*cmd_vel[JOINTS];			// pin: estimated command velocity (position units/sec)
+	hal_float_t		*cmd_acc[JOINTS];			// pin: estimated command acceleration (position units/sec^2)
 	hal_float_t		*deadband[JOINTS];
 	float 			old_pos_cmd[JOINTS];		// previous position command (counts)
 	float 			old_pos_cmd_raw[JOINTS];		// previous position command (counts)
-	float 			old_scale[JOINTS];			// stored scale value
-	float 			scale_recip[JOINTS];		// reciprocal value used for scaling
-	float			prev_cmd[JOINTS];
-	float			cmd_d[JOINTS];					// command derivative
+	double 			old_scale[JOINTS];			// stored scale value
+	double 			scale_recip[JOINTS];		// reciprocal value used for scaling, position units per accumulator count
+	double			old_maxvel[JOINTS];			// parameters the cached limits were calculated from
+	double			old_maxaccel[JOINTS];
+	double			old_maxfreq[JOINTS];
+	bool			new_scale[JOINTS];			// scale changed since the limits were calculated
+	double			lim_freq[JOINTS];			// cached limit: step rate (Hz)
+	double			lim_dv[JOINTS];				// cached limit: step rate change in one period (Hz)
+	double			min_deadband[JOINTS];		// default deadband, one step (position units)
+	double			prev_cmd[JOINTS];
+	double			cmd_d[JOINTS];					// command derivative
+	double			cmd_dd[JOINTS];					// command second derivative
+	double			old_cmd_filter[JOINTS];
+	double			cmd_alpha[JOINTS];				// command derivative filter coefficient, 1 for none
 	hal_float_t 	*setPoint[VARIABLES];
 	hal_float_t 	*processVariable[VARIABLES];
 	hal_bit_t   	*outputs[DIGITAL_OUTPUTS];
@@ -91,47 +126,22 @@ typedef struct {
 static data_t *data;
 
 
-typedef union
-{
-  // this allow structured access to the outgoing SPI data without having to move it
-  // this is the same structure as the PRU rxData structure
-  struct
-  {
-    uint8_t txBuffer[SPIBUFSIZE];
-  };
-  struct
-  {
-	int32_t header;
-    int32_t jointFreqCmd[JOINTS];
-    float 	setPoint[VARIABLES];
-	uint8_t jointEnable;
-	uint8_t outputs;
-	uint8_t spare2;
-    uint8_t spare1;
-  };
-} txData_t;
-
-static txData_t txData;
-
-
-typedef union
-{
-  // this allow structured access to the incoming SPI data without having to move it
-  // this is the same structure as the PRU txData structure
-  struct
-  {
-    uint8_t rxBuffer[SPIBUFSIZE];
-  };
-  struct
-  {
-    int32_t header;
-    int32_t jointFeedback[JOINTS];
-    float 	processVariable[VARIABLES];
-    uint8_t inputs;
-  };
-} rxData_t;
+// SPI frames, see remora.h. Word aligned so the CRC can be taken a word at a time
+static uint32_t		txFrame[SPIBUFSIZE/4];
+static uint32_t		rxFrame[SPIBUFSIZE/4];
+
+static int			frameJoints = 0;		// layout agreed with the PRU
+static int			frameVariables = 0;
+static int			frameSize = 0;			// bytes, 0 until the layout has been read from the PRU
+static uint8_t		txSequence = 0;
+static uint8_t		pruSequence = 0;		// sequence number of the last PRU frame
+
+static uint32_t		crcTable[256];
 
-static rxData_t rxData;
+static uint32_t		timingCount[FRAME_SLOTS];	// last 24 bit count of each timing slot
+static bool			timingSeen[FRAME_SLOTS];	// slot counted since the layout was agreed
+
+static transport_t	*spi;					// SPI transport selected by the transport parameter
 
 
 
@@ -147,23 +157,29 @@ static double 		recip_dt;				// recprocal of period, avoids divides
 static int64_t 		accum[JOINTS] = { 0 };
 static int32_t 		old_count[JOINTS] = { 0 };
 static int32_t		accum_diff = 0;
+static int			command_lead = 1;		// servo periods from update_freq until the PRU reaches the position setpoint
 
 typedef enum CONTROL { POSITION, VELOCITY, INVALID } CONTROL;
 
-static int reset_gpio_pin = 25;				// RPI GPIO pin number used to force watchdog reset of the PRU 
-
 
 
 /***********************************************************************
 *                  LOCAL FUNCTION DECLARATIONS                         *
 ************************************************************************/
-static int rt_bcm2835_init(void);
-
 static void update_freq(void *arg, long period);
+static void update_scale(int i);
+static void update_limits(int i);
+static void update_filter(int i);
 static void spi_write();
 static void spi_read();
-static void spi_transfer();
+static void spi_exchange();
+static void pack_commands();
+static void spi_feedback_transfer();
+static void spi_transfer(int length);
+static void crc_init(void);
+static uint32_t frame_crc(const uint32_t *data, int words);
 static CONTROL parse_ctrl_type(const char *ctrl);
+static transport_t *parse_transport(const char *name);
 
 /***********************************************************************
 *                       INIT AND EXIT CODE                             *
@@ -200,49 +216,24 @@ int rtapi_app_main(void)
 		return -1;
 	}
 
-	// Map the RPi BCM2835 peripherals - uses "rtapi_open_as_root" in place of "open"
-	if (!rt_bcm2835_init())
-    {
-      rtapi_print_msg(RTAPI_MSG_ERR,"rt_bcm2835_init failed. Are you running with root privlages??\n");
-      return -1;
-    }
-
-	// Set the SPI0 pins to the Alt 0 function to enable SPI0 access, setup CS register
-	// and clear TX and RX fifos
-	if (!bcm2835_spi_begin())
-    {
-      rtapi_print_msg(RTAPI_MSG_ERR,"bcm2835_spi_begin failed. Are you running with root privlages??\n");
-      return -1;
-    }
-
-	// Configure SPI0
-	bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);      // The default
-	bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);                   // The default
-
-	//bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_128);		// 3.125MHz on RPI3
-	//bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_64);		// 6.250MHz on RPI3 <- LPC1768 setting
-	//bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_32);		// 12.5MHz on RPI3
-	bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_16);		// 25MHz on RPI3    <- STM32F4 setting
-	//bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_8);	// fail....
-
-
-
-
-    bcm2835_spi_chipSelect(BCM2835_SPI_CS0);                      // The default
-    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);      // the default
-
+	spi = parse_transport(transport);
+	if (spi == NULL)
+	{
+		rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: unknown SPI transport '%s'\n", modname, transport);
+		hal_exit(comp_id);
+		return -1;
+	}
 
-	/* RPI_GPIO_P1_19        = 10 		MOSI when SPI0 in use
-     * RPI_GPIO_P1_21        =  9 		MISO when SPI0 in use
-     * RPI_GPIO_P1_23        = 11 		CLK when SPI0 in use
-     * RPI_GPIO_P1_24        =  8 		CE0 when SPI0 in use
-     * RPI_GPIO_P1_26        =  7 		CE1 when SPI0 in use
-	 */
+	spidev_path = spidev;
+	spidev_speed = spi_speed;
+	spidev_reset_path = reset_gpio;
 
-	// Configure pullups on SPI0 pins - source termination and CS high (does this allows for higher clock frequencies??? wiring is more important here)
-	bcm2835_gpio_set_pud(RPI_GPIO_P1_19, BCM2835_GPIO_PUD_DOWN);	// MOSI
-	bcm2835_gpio_set_pud(RPI_GPIO_P1_21, BCM2835_GPIO_PUD_DOWN);	// MISO
-	bcm2835_gpio_set_pud(RPI_GPIO_P1_24, BCM2835_GPIO_PUD_UP);		// CS0
+	if (spi->init() != 0)
+	{
+		rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: %s transport failed to start\n", modname, spi->name);
+		hal_exit(comp_id);
+		return -1;
+	}
 
 	// export spiPRU SPI enable and status bits
 	retval = hal_pin_bit_newf(HAL_IN, &(data->SPIenable),
@@ -257,7 +248,35 @@ int rtapi_app_main(void)
 			comp_id, "%s.SPI-status", prefix);
 	if (retval != 0) goto error;
 
-	bcm2835_gpio_fsel(reset_gpio_pin, BCM2835_GPIO_FSEL_OUTP);
+	retval = hal_pin_u32_newf(HAL_OUT, &(data->SPIseqErrors),
+			comp_id, "%s.SPI-seq-errors", prefix);
+	if (retval != 0) goto error;
+	*(data->SPIseqErrors) = 0;
+
+	retval = hal_pin_u32_newf(HAL_OUT, &(data->SPIframeTime),
+			comp_id, "%s.SPI-frame-time", prefix);
+	if (retval != 0) goto error;
+	*(data->SPIframeTime) = 0;
+
+	retval = hal_pin_u32_newf(HAL_OUT, &(data->SPIframeInterval),
+			comp_id, "%s.SPI-frame-interval", prefix);
+	if (retval != 0) goto error;
+	*(data->SPIframeInterval) = 0;
+
+	for (n = 0; n < FRAME_HIST_BINS; n++) {
+		retval = hal_pin_u32_newf(HAL_OUT, &(data->SPIjitter[n]),
+				comp_id, "%s.SPI-jitter.%02d", prefix, n);
+		if (retval != 0) goto error;
+		*(data->SPIjitter[n]) = 0;
+	}
+
+	retval = hal_pin_u32_newf(HAL_OUT, &(data->SPImissed),
+			comp_id, "%s.SPI-missed", prefix);
+	if (retval != 0) goto error;
+	*(data->SPImissed) = 0;
+
+	crc_init();
+
 	retval = hal_pin_bit_newf(HAL_IN, &(data->PRUreset),
 			comp_id, "%s.PRU-reset", prefix);
 	if (retval != 0) goto error;
@@ -332,11 +351,36 @@ This is throwing errors from axis.py for some reason...
 		if (retval < 0) goto error;
 		*(data->ff1gain[n]) = 0.0;
 		
+		retval = hal_pin_float_newf(HAL_IN, &(data->ff2gain[n]),
+				comp_id, "%s.joint.%01d.ff2gain", prefix, n);
+		if (retval < 0) goto error;
+		*(data->ff2gain[n]) = 0.0;
+		
+		retval = hal_pin_float_newf(HAL_IN, &(data->cmd_filter[n]),
+				comp_id, "%s.joint.%01d.cmd-filter", prefix, n);
+		if (retval < 0) goto error;
+		*(data->cmd_filter[n]) = 0.0;
+		
+		retval = hal_pin_float_newf(HAL_OUT, &(data->cmd_vel[n]),
+				comp_id, "%s.joint.%01d.cmd-vel", prefix, n);
+		if (retval < 0) goto error;
+		*(data->cmd_vel[n]) = 0.0;
+		
+		retval = hal_pin_float_newf(HAL_OUT, &(data->cmd_acc[n]),
+				comp_id, "%s.joint.%01d.cmd-acc", prefix, n);
+		if (retval < 0) goto error;
+		*(data->cmd_acc[n]) = 0.0;
+		
 		retval = hal_pin_float_newf(HAL_IN, &(data->deadband[n]),
 				comp_id, "%s.joint.%01d.deadband", prefix, n);
 		if (retval < 0) goto error;
 		*(data->deadband[n]) = 0.0;
 		
+		retval = hal_param_float_newf(HAL_RW, &(data->maxfreq[n]),
+		        comp_id, "%s.joint.%01d.max-freq", prefix, n);
+		if (retval < 0) goto error;
+		data->maxfreq[n] = PRU_BASEFREQ/(2.0);
+
 		retval = hal_param_float_newf(HAL_RW, &(data->maxaccel[n]),
 		        comp_id, "%s.joint.%01d.maxaccel", prefix, n);
 		if (retval < 0) goto error;
@@ -413,6 +457,16 @@ This is throwing errors from axis.py for some reason...
 		return -1;
 	}
 
+	// spi_read and spi_write in one transfer, in place of the read and write functions
+	rtapi_snprintf(name, sizeof(name), "%s.exchange", prefix);
+	retval = hal_export_funct(name, spi_exchange, data, 1, 0, comp_id);
+	if (retval < 0) {
+		rtapi_print_msg(RTAPI_MSG_ERR,
+		        "%s: ERROR: exchange function export failed\n", modname);
+		hal_exit(comp_id);
+		return -1;
+	}
+
 	rtapi_print_msg(RTAPI_MSG_INFO, "%s: installed driver\n", modname);
 	hal_ready(comp_id);
     return 0;
@@ -420,6 +474,7 @@ This is throwing errors from axis.py for some reason...
 
 void rtapi_app_exit(void)
 {
+	spi->exit();
     hal_exit(comp_id);
 }
 
@@ -429,161 +484,15 @@ void rtapi_app_exit(void)
 ************************************************************************/
 
 
-// This is the same as the standard bcm2835 library except for the use of
-// "rtapi_open_as_root" in place of "open"
-
-int rt_bcm2835_init(void)
-{
-    int  memfd;
-    int  ok;
-    FILE *fp;
-
-    if (debug) 
-    {
-        bcm2835_peripherals = (uint32_t*)BCM2835_PERI_BASE;
-
-	bcm2835_pads = bcm2835_peripherals + BCM2835_GPIO_PADS/4;
-	bcm2835_clk  = bcm2835_peripherals + BCM2835_CLOCK_BASE/4;
-	bcm2835_gpio = bcm2835_peripherals + BCM2835_GPIO_BASE/4;
-	bcm2835_pwm  = bcm2835_peripherals + BCM2835_GPIO_PWM/4;
-	bcm2835_spi0 = bcm2835_peripherals + BCM2835_SPI0_BASE/4;
-	bcm2835_bsc0 = bcm2835_peripherals + BCM2835_BSC0_BASE/4;
-	bcm2835_bsc1 = bcm2835_peripherals + BCM2835_BSC1_BASE/4;
-	bcm2835_st   = bcm2835_peripherals + BCM2835_ST_BASE/4;
-	bcm2835_aux  = bcm2835_peripherals + BCM2835_AUX_BASE/4;
-	bcm2835_spi1 = bcm2835_peripherals + BCM2835_SPI1_BASE/4;
-
-	return 1; /* Success */
-    }
-
-    /* Figure out the base and size of the peripheral address block
-    // using the device-tree. Required for RPi2/3/4, optional for RPi 1
-    */
-    if ((fp = fopen(BMC2835_RPI2_DT_FILENAME , "rb")))
-    {
-        unsigned char buf[16];
-        uint32_t base_address;
-        uint32_t peri_size;
-        if (fread(buf, 1, sizeof(buf), fp) >= 8)
-        {
-            base_address = (buf[4] << 24) |
-              (buf[5] << 16) |
-              (buf[6] << 8) |
-              (buf[7] << 0);
-            
-            peri_size = (buf[8] << 24) |
-              (buf[9] << 16) |
-              (buf[10] << 8) |
-              (buf[11] << 0);
-            
-            if (!base_address)
-            {
-                /* looks like RPI 4 */
-                base_address = (buf[8] << 24) |
-                      (buf[9] << 16) |
-                      (buf[10] << 8) |
-                      (buf[11] << 0);
-                      
-                peri_size = (buf[12] << 24) |
-                (buf[13] << 16) |
-                (buf[14] << 8) |
-                (buf[15] << 0);
-            }
-            /* check for valid known range formats */
-            if ((buf[0] == 0x7e) &&
-                    (buf[1] == 0x00) &&
-                    (buf[2] == 0x00) &&
-                    (buf[3] == 0x00) &&
-                    ((base_address == BCM2835_PERI_BASE) || (base_address == BCM2835_RPI2_PERI_BASE) || (base_address == BCM2835_RPI4_PERI_BASE)))
-            {
-                bcm2835_peripherals_base = (off_t)base_address;
-                bcm2835_peripherals_size = (size_t)peri_size;
-                if( base_address == BCM2835_RPI4_PERI_BASE )
-                {
-                    pud_type_rpi4 = 1;
-                }
-            }
-        
-        }
-        
-	fclose(fp);
-    }
-    /* else we are prob on RPi 1 with BCM2835, and use the hardwired defaults */
-
-    /* Now get ready to map the peripherals block 
-     * If we are not root, try for the new /dev/gpiomem interface and accept
-     * the fact that we can only access GPIO
-     * else try for the /dev/mem interface and get access to everything
-     */
-    memfd = -1;
-    ok = 0;
-    if (geteuid() == 0)
-    {
-      /* Open the master /dev/mem device */
-      if ((memfd = rtapi_open_as_root("/dev/mem", O_RDWR | O_SYNC) ) < 0) 
-	{
-	  fprintf(stderr, "bcm2835_init: Unable to open /dev/mem: %s\n",
-		  strerror(errno)) ;
-	  goto exit;
-	}
-      
-      /* Base of the peripherals block is mapped to VM */
-      bcm2835_peripherals = mapmem("gpio", bcm2835_peripherals_size, memfd, bcm2835_peripherals_base);
-      if (bcm2835_peripherals == MAP_FAILED) goto exit;
-      
-      /* Now compute the base addresses of various peripherals, 
-      // which are at fixed offsets within the mapped peripherals block
-      // Caution: bcm2835_peripherals is uint32_t*, so divide offsets by 4
-      */
-      bcm2835_gpio = bcm2835_peripherals + BCM2835_GPIO_BASE/4;
-      bcm2835_pwm  = bcm2835_peripherals + BCM2835_GPIO_PWM/4;
-      bcm2835_clk  = bcm2835_peripherals + BCM2835_CLOCK_BASE/4;
-      bcm2835_pads = bcm2835_peripherals + BCM2835_GPIO_PADS/4;
-      bcm2835_spi0 = bcm2835_peripherals + BCM2835_SPI0_BASE/4;
-      bcm2835_bsc0 = bcm2835_peripherals + BCM2835_BSC0_BASE/4; /* I2C */
-      bcm2835_bsc1 = bcm2835_peripherals + BCM2835_BSC1_BASE/4; /* I2C */
-      bcm2835_st   = bcm2835_peripherals + BCM2835_ST_BASE/4;
-      bcm2835_aux  = bcm2835_peripherals + BCM2835_AUX_BASE/4;
-      bcm2835_spi1 = bcm2835_peripherals + BCM2835_SPI1_BASE/4;
-
-      ok = 1;
-    }
-    else
-    {
-      /* Not root, try /dev/gpiomem */
-      /* Open the master /dev/mem device */
-      if ((memfd = open("/dev/gpiomem", O_RDWR | O_SYNC) ) < 0) 
-	{
-	  fprintf(stderr, "bcm2835_init: Unable to open /dev/gpiomem: %s\n",
-		  strerror(errno)) ;
-	  goto exit;
-	}
-      
-      /* Base of the peripherals block is mapped to VM */
-      bcm2835_peripherals_base = 0;
-      bcm2835_peripherals = mapmem("gpio", bcm2835_peripherals_size, memfd, bcm2835_peripherals_base);
-      if (bcm2835_peripherals == MAP_FAILED) goto exit;
-      bcm2835_gpio = bcm2835_peripherals;
-      ok = 1;
-    }
-
-exit:
-    if (memfd >= 0)
-        close(memfd);
-
-    if (!ok)
-	bcm2835_close();
-
-    return ok;
-}
 
 void update_freq(void *arg, long period)
 {
 	int i;
 	data_t *data = (data_t *)arg;
-	double max_ac, vel_cmd, dv, new_vel, max_freq, desired_freq;
+	double vel_cmd, dv, new_vel, max_freq, target_freq;
+	bool new_period = false;
 		   
-	double error, command, feedback;
+	double error, command, feedback, raw_d, new_d;
 	double periodfp, periodrecip;
 	float pgain, ff1gain, deadband;
 
@@ -598,76 +507,31 @@ void update_freq(void *arg, long period)
 		old_dtns = period;				// get ready to detect future period changes
 		dt = period * 0.000000001; 		// dt is the period of this thread, used for the position loop
 		recip_dt = 1.0 / dt;			// calc the reciprocal once here, to avoid multiple divides later
+		new_period = true;				// the acceleration limits depend on the period
     }
 
     // loop through generators
 	for (i = 0; i < JOINTS; i++)
 	{
-		// check for scale change
-		if (data->pos_scale[i] != data->old_scale[i])
-		{
-			data->old_scale[i] = data->pos_scale[i];		// get ready to detect future scale changes
-			// scale must not be 0
-			if ((data->pos_scale[i] < 1e-20) && (data->pos_scale[i] > -1e-20))	// validate the new scale value
-				data->pos_scale[i] = 1.0;										// value too small, divide by zero is a bad thing
-				// we will need the reciprocal, and the accum is fixed point with
-				//fractional bits, so we precalc some stuff
-			data->scale_recip[i] = (1.0 / STEP_MASK) / data->pos_scale[i];
-		}
-
-		// calculate frequency limit
-		//max_freq = PRU_BASEFREQ/(4.0); 			//limit of DDS running at 80kHz
-		max_freq = PRU_BASEFREQ/(2.0); 	
-
+		// the limits only change with the parameters, setp is rare compared to the servo thread
+		if (data->pos_scale[i] != data->old_scale[i]) update_scale(i);
 
-		// check for user specified frequency limit parameter
-		if (data->maxvel[i] <= 0.0)
+		if (new_period || data->new_scale[i] ||
+				data->maxvel[i] != data->old_maxvel[i] ||
+				data->maxaccel[i] != data->old_maxaccel[i] ||
+				data->maxfreq[i] != data->old_maxfreq[i])
 		{
-			// set to zero if negative
-			data->maxvel[i] = 0.0;
+			update_limits(i);
 		}
-		else
-		{
-			// parameter is non-zero, compare to max_freq
-			desired_freq = data->maxvel[i] * fabs(data->pos_scale[i]);
 
-			if (desired_freq > max_freq)
-			{
-				// parameter is too high, limit it
-				data->maxvel[i] = max_freq / fabs(data->pos_scale[i]);
-			}
-			else
-			{
-				// lower max_freq to match parameter
-				max_freq = data->maxvel[i] * fabs(data->pos_scale[i]);
-			}
-		}
-		
-		/* set internal accel limit to its absolute max, which is
-		zero to full speed in one thread period */
-		max_ac = max_freq * recip_dt;
-		
-		// check for user specified accel limit parameter
-		if (data->maxaccel[i] <= 0.0)
+		if (new_period || *(data->cmd_filter[i]) != data->old_cmd_filter[i])
 		{
-			// set to zero if negative
-			data->maxaccel[i] = 0.0;
-		}
-		else 
-		{
-			// parameter is non-zero, compare to max_ac
-			if ((data->maxaccel[i] * fabs(data->pos_scale[i])) > max_ac)
-			{
-				// parameter is too high, lower it
-				data->maxaccel[i] = max_ac / fabs(data->pos_scale[i]);
-			}
-			else
-			{
-				// lower limit to match parameter
-				max_ac = data->maxaccel[i] * fabs(data->pos_scale[i]);
-			}
+			update_filter(i);
 		}
 
+		max_freq = data->lim_freq[i];
+		dv = data->lim_dv[i];
+
 		/* at this point, all scaling, limits, and other parameter
 		changes have been handled - time for the main control */
 
@@ -677,7 +541,7 @@ void update_freq(void *arg, long period)
 
 			/* POSITION CONTROL MODE */
 
-			// use Proportional control with feed forward (pgain, ff1gain and deadband)
+			// use Proportional control with feed forward (pgain, ff1gain, ff2gain and deadband)
 			
 			if (*(data->pgain[i]) != 0)
 			{
@@ -703,7 +567,7 @@ void update_freq(void *arg, long period)
 			}
 			else
 			{
-				deadband = 1 / data->pos_scale[i];
+				deadband = data->min_deadband[i];
 			}	
 
 			// read the command and feedback
@@ -727,14 +591,25 @@ void update_freq(void *arg, long period)
 				error = 0;
 			}
 			
-			// calcuate command and derivatives
-			data->cmd_d[i] = (command - data->prev_cmd[i]) * periodrecip;
+			// calcuate command and derivatives, through a first order low pass when cmd-filter is set.
+			// The first difference of a position sampled once a period is noisy, the second more so
+			raw_d = (command - data->prev_cmd[i]) * periodrecip;
+			new_d = data->cmd_d[i] + data->cmd_alpha[i] * (raw_d - data->cmd_d[i]);
+			data->cmd_dd[i] += data->cmd_alpha[i] * ((new_d - data->cmd_d[i]) * periodrecip - data->cmd_dd[i]);
+			data->cmd_d[i] = new_d;
 			
 			// save old values
 			data->prev_cmd[i] = command;
+			*(data->cmd_vel[i]) = data->cmd_d[i];
+			*(data->cmd_acc[i]) = data->cmd_dd[i];
 				
-			// calculate the output value
-			vel_cmd = pgain * error + data->cmd_d[i] * ff1gain;
+			// calculate the output value. ff2gain is in seconds, about the delay from the command
+			// to the steps, so the acceleration term makes up the velocity lost in that time
+			vel_cmd = pgain * error + data->cmd_d[i] * ff1gain + data->cmd_dd[i] * *(data->ff2gain[i]);
+
+			// the position setpoint is the command taken ahead to when the PRU reaches it
+			target_freq = (llround((command + data->cmd_d[i] * dt * command_lead) * data->pos_scale[i] * STEP_MASK) -
+				data->pos_target[i]) * recip_dt / STEP_MASK;
 		
 		} else {
 
@@ -756,9 +631,6 @@ void update_freq(void *arg, long period)
 			vel_cmd = -max_freq;
 		}
 		
-		// calc max change in frequency in one period
-		dv = max_ac * dt;
-		
 		// apply accel limit
 		if ( vel_cmd > (data->freq[i] + dv) )
 		{
@@ -781,28 +653,265 @@ void update_freq(void *arg, long period)
 		
 		data->freq[i] = new_vel;				// to be sent to the PRU
 		*(data->freq_cmd[i]) = data->freq[i];	// feedback to LinuxCNC
+
+		// the position setpoint, for a Stepgen that interpolates, moves on from the last one at a
+		// step rate held to the same limits. In velocity mode it follows the frequency command,
+		// and a disabled joint holds it at the feedback
+		if (!data->pos_mode[i]) target_freq = new_vel;
+
+		if (target_freq > max_freq) target_freq = max_freq;
+		else if (target_freq < -max_freq) target_freq = -max_freq;
+
+		if (target_freq > data->target_freq[i] + dv) target_freq = data->target_freq[i] + dv;
+		else if (target_freq < data->target_freq[i] - dv) target_freq = data->target_freq[i] - dv;
+
+		if (*(data->stepperEnable[i]) == 0)
+		{
+			target_freq = 0;
+			data->pos_target[i] = accum[i];
+		}
+
+		data->target_freq[i] = target_freq;
+		data->pos_target[i] += llround(target_freq * dt * STEP_MASK);
 	}
 
 }
 
 
+
+void update_scale(int i)
+{
+	// scale must not be 0
+	if ((data->pos_scale[i] < 1e-20) && (data->pos_scale[i] > -1e-20))	// validate the new scale value
+		data->pos_scale[i] = 1.0;										// value too small, divide by zero is a bad thing
+	data->old_scale[i] = data->pos_scale[i];		// get ready to detect future scale changes
+
+	// we will need the reciprocal, and the accum is fixed point with
+	// fractional bits, so we precalc some stuff
+	data->scale_recip[i] = (1.0 / STEP_MASK) / data->pos_scale[i];
+	data->min_deadband[i] = 1.0 / fabs(data->pos_scale[i]);
+	data->new_scale[i] = true;						// the limits are in steps
+}
+
+
+void update_limits(int i)
+{
+	double max_ac, max_freq, desired_freq;
+	double scale = fabs(data->pos_scale[i]);
+
+	// calculate frequency limit
+	//max_freq = PRU_BASEFREQ/(4.0); 			//limit of DDS running at 80kHz
+	// a Base thread Stepgen is limited to PRU_BASEFREQ/2, or PRU_BASEFREQ when it has a Step Length,
+	// and a DMA Stepgen to PRU_DMAFREQ/2
+	if (data->maxfreq[i] <= 0.0)
+	{
+		data->maxfreq[i] = PRU_BASEFREQ/(2.0);
+	}
+	else if (data->maxfreq[i] > PRU_DMAFREQ/(2.0))
+	{
+		data->maxfreq[i] = PRU_DMAFREQ/(2.0);
+	}
+	max_freq = data->maxfreq[i];
+
+
+	// check for user specified frequency limit parameter
+	if (data->maxvel[i] <= 0.0)
+	{
+		// set to zero if negative
+		data->maxvel[i] = 0.0;
+	}
+	else
+	{
+		// parameter is non-zero, compare to max_freq
+		desired_freq = data->maxvel[i] * scale;
+
+		if (desired_freq > max_freq)
+		{
+			// parameter is too high, limit it
+			data->maxvel[i] = max_freq / scale;
+		}
+		else
+		{
+			// lower max_freq to match parameter
+			max_freq = data->maxvel[i] * scale;
+		}
+	}
+	
+	/* set internal accel limit to its absolute max, which is
+	zero to full speed in one thread period */
+	max_ac = max_freq * recip_dt;
+	
+	// check for user specified accel limit parameter
+	if (data->maxaccel[i] <= 0.0)
+	{
+		// set to zero if negative
+		data->maxaccel[i] = 0.0;
+	}
+	else 
+	{
+		// parameter is non-zero, compare to max_ac
+		if ((data->maxaccel[i] * scale) > max_ac)
+		{
+			// parameter is too high, lower it
+			data->maxaccel[i] = max_ac / scale;
+		}
+		else
+		{
+			// lower limit to match parameter
+			max_ac = data->maxaccel[i] * scale;
+		}
+	}
+
+	data->lim_freq[i] = max_freq;
+	data->lim_dv[i] = max_ac * dt;			// max change in frequency in one period
+
+	// the parameters after validation, so a clamped value is not seen as a change
+	data->old_maxvel[i] = data->maxvel[i];
+	data->old_maxaccel[i] = data->maxaccel[i];
+	data->old_maxfreq[i] = data->maxfreq[i];
+	data->new_scale[i] = false;
+}
+
+
+void update_filter(int i)
+{
+	data->old_cmd_filter[i] = *(data->cmd_filter[i]);
+
+	// discrete first order low pass at the cutoff, cmd_alpha of 1 passes the first difference
+	if (data->old_cmd_filter[i] > 0.0)
+	{
+		data->cmd_alpha[i] = 1.0 - exp(-2.0 * M_PI * data->old_cmd_filter[i] * dt);
+	}
+	else
+	{
+		data->cmd_alpha[i] = 1.0;
+	}
+}
+
 void spi_read()
+{
+	frameHeader_t *txHeader = (frameHeader_t *)txFrame;
+
+	// Data header. A READ carries no data so the PRU does not check it
+	txHeader->header = PRU_READ;
+	txHeader->version = REMORA_FRAME_VERSION;
+	txHeader->sequence = txSequence++;
+	txHeader->joints = frameJoints;
+	txHeader->variables = frameVariables;
+
+	spi_feedback_transfer();
+}
+
+
+void spi_write()
+{
+	// the layout is agreed in spi_read, nothing is written until then
+	if (!*(data->SPIstatus) || !frameSize) return;
+
+	command_lead = 1;					// the commands go out in the period they are made
+
+	pack_commands();
+
+	// Transfer to and from the PRU, the PRU frame received is not used
+	spi_transfer(frameSize);
+	pruSequence++;
+}
+
+
+void spi_exchange()
+{
+	// one transfer per servo period: the commands from the last update_freq go out and the
+	// feedback comes back in the same frame. Until the layout is agreed this is a READ
+	if (*(data->SPIstatus) && frameSize)
+	{
+		command_lead = 2;				// the commands go out a period after they are made
+		pack_commands();
+		spi_feedback_transfer();
+	}
+	else
+	{
+		spi_read();
+	}
+}
+
+
+void pack_commands()
 {
 	int i;
-	double curr_pos;
+	frameHeader_t *txHeader = (frameHeader_t *)txFrame;
+	uint32_t *word = txFrame + 2;
+	uint8_t *bits;
+	float value;
 
 	// Data header
-	txData.header = PRU_READ;
+	txHeader->header = PRU_WRITE;
+	txHeader->version = REMORA_FRAME_VERSION;
+	txHeader->sequence = txSequence++;
+	txHeader->joints = frameJoints;
+	txHeader->variables = frameVariables;
+
+	// Joint frequency commands
+	for (i = 0; i < frameJoints; i++)
+	{
+		*word++ = (int32_t)data->freq[i];
+	}
+
+	// Joint position setpoints
+	for (i = 0; i < frameJoints; i++)
+	{
+		*word++ = (int32_t)data->pos_target[i];
+	}
+
+	// Set points
+	for (i = 0; i < frameVariables; i++)
+	{
+		value = *(data->setPoint[i]);
+		memcpy(word++, &value, sizeof(value));
+	}
+
+	bits = (uint8_t *)word++;
+	bits[0] = 0;
+	bits[1] = 0;
+	bits[2] = 0;
+	bits[3] = 0;
+
+	*word++ = 0;		// timestamp and timing, only the PRU uses them
+	*word++ = 0;
+
+	for (i = 0; i < JOINTS; i++)
+	{
+		if (*(data->stepperEnable[i]) == 1)
+		{
+			bits[0] |= (1 << i);
+		}
+	}
+
+	// Outputs
+	for (i = 0; i < DIGITAL_OUTPUTS; i++)
+	{
+		if (*(data->outputs[i]) == 1)
+		{
+			bits[1] |= (1 << i);		// output is high
+		}
+	}
+
+	*word = frame_crc(txFrame, FRAME_WORDS(frameJoints, frameVariables) - 1);
+}
+
+
+void spi_feedback_transfer()
+{
+	int i;
+	frameHeader_t *rxHeader = (frameHeader_t *)rxFrame;
+	uint32_t *word;
+	float value;
+	uint8_t inputs;
+	uint32_t timing, slot;
+
+	// send the frame already in txFrame and process the PRU feedback frame received
 	
 	// update the PRUreset output
-	if (*(data->PRUreset))
-	{ 
-		bcm2835_gpio_set(reset_gpio_pin);
-    }
-	else
-	{
-		bcm2835_gpio_clr(reset_gpio_pin);
-    }
+	spi->reset(*(data->PRUreset));
 	
 	if (*(data->SPIenable))
 	{
@@ -810,39 +919,77 @@ void spi_read()
 		{
 			// reset rising edge detected, try SPI transfer and reset OR PRU running
 			
-			// Transfer to and from the PRU
-			spi_transfer();
+			// Transfer to and from the PRU. Until the layout is known read the largest frame,
+			// the PRU drops the bytes beyond its own frame
+			spi_transfer(frameSize ? frameSize : SPIBUFSIZE);
 
-			switch (rxData.header)		// only process valid SPI payloads. This rejects bad payloads
+			switch (rxHeader->header)		// only process valid SPI payloads. This rejects bad payloads
 			{
 				case PRU_DATA:
+					// check the version, the layout and the CRC before using any of the data
+					if (rxHeader->version != REMORA_FRAME_VERSION ||
+						rxHeader->joints > JOINTS || rxHeader->variables > VARIABLES ||
+						(frameSize && (rxHeader->joints != frameJoints || rxHeader->variables != frameVariables)) ||
+						frame_crc(rxFrame, FRAME_WORDS(rxHeader->joints, rxHeader->variables) - 1) != rxFrame[FRAME_WORDS(rxHeader->joints, rxHeader->variables) - 1])
+					{
+						*(data->SPIstatus) = 0;
+						frameSize = 0;				// read the layout again on the next reset
+						rtapi_print("Bad SPI frame, version %d, %d joints, %d variables\n", rxHeader->version, rxHeader->joints, rxHeader->variables);
+						break;
+					}
+
+					if (!frameSize)
+					{
+						// first good frame, agree the frame size from the PRU layout
+						frameJoints = rxHeader->joints;
+						frameVariables = rxHeader->variables;
+						frameSize = FRAME_SIZE(frameJoints, frameVariables);
+						memset(timingSeen, 0, sizeof(timingSeen));
+						*(data->SPIframeTime) = 0;
+						rtapi_print_msg(RTAPI_MSG_INFO, "%s: SPI frame %d joints, %d variables, %d bytes\n", modname, frameJoints, frameVariables, frameSize);
+					}
+					else if (rxHeader->sequence != (uint8_t)(pruSequence + 1))
+					{
+						// the PRU sends a new frame for every transfer
+						(*(data->SPIseqErrors))++;
+					}
+					pruSequence = rxHeader->sequence;
+
 					// we have received a GOOD payload from the PRU
 					*(data->SPIstatus) = 1;
 
-					for (i = 0; i < JOINTS; i++)
+					word = rxFrame + 2;
+
+					for (i = 0; i < frameJoints; i++)
 					{
 						// the PRU DDS accumulator uses 32 bit counter, this code converts that counter into 64 bits */
-						accum_diff = rxData.jointFeedback[i] - old_count[i];
-						old_count[i] = rxData.jointFeedback[i];
+						accum_diff = (int32_t)*word - old_count[i];
+						old_count[i] = (int32_t)*word++;
 						accum[i] += accum_diff;
 
 						*(data->count[i]) = accum[i] >> STEPBIT;
 
-						data->scale_recip[i] = (1.0 / STEP_MASK) / data->pos_scale[i];
-						curr_pos = (double)(accum[i]-STEP_OFFSET) * (1.0 / STEP_MASK);
-						*(data->pos_fb[i]) = (float)((curr_pos+0.5) / data->pos_scale[i]);
+						// scale_recip is refreshed here too, the feedback can run before update_freq sees a new scale
+						if (data->pos_scale[i] != data->old_scale[i]) update_scale(i);
+
+						// (accum - STEP_OFFSET) / STEP_MASK + 0.5 steps, and STEP_OFFSET is half a step
+						*(data->pos_fb[i]) = (float)((double)accum[i] * data->scale_recip[i]);
 					}
 
+					word += frameJoints;		// the position words are only used in a WRITE
+
 					// Feedback
-					for (i = 0; i < VARIABLES; i++)
+					for (i = 0; i < frameVariables; i++)
 					{
-						*(data->processVariable[i]) = rxData.processVariable[i]; 
+						memcpy(&value, word++, sizeof(value));
+						*(data->processVariable[i]) = value; 
 					}
 
 					// Inputs
+					inputs = ((uint8_t *)word++)[0];
 					for (i = 0; i < DIGITAL_INPUTS; i++)
 					{
-						if ((rxData.inputs & (1 << i)) != 0)
+						if ((inputs & (1 << i)) != 0)
 						{
 							*(data->inputs[i]) = 1; 		// input is high
 						}
@@ -851,6 +998,36 @@ void spi_read()
 							*(data->inputs[i]) = 0;			// input is low
 						}
 					}
+
+					// PRU frame timing, the timestamp moves on once per WRITE
+					if (*word != *(data->SPIframeTime))
+					{
+						if (*(data->SPIframeTime) != 0) *(data->SPIframeInterval) = *word - *(data->SPIframeTime);
+						*(data->SPIframeTime) = *word;
+					}
+					word++;
+
+					// the counts go out 24 bits at a time, the pins add up the change since the
+					// slot was last seen
+					timing = *word;
+					slot = timing >> 24;
+					if (slot < FRAME_SLOTS)
+					{
+						timing &= FRAME_COUNT_MASK;
+						if (timingSeen[slot])
+						{
+							if (slot == FRAME_SLOT_MISSED)
+							{
+								*(data->SPImissed) += (timing - timingCount[slot]) & FRAME_COUNT_MASK;
+							}
+							else
+							{
+								*(data->SPIjitter[slot]) += (timing - timingCount[slot]) & FRAME_COUNT_MASK;
+							}
+						}
+						timingCount[slot] = timing;
+						timingSeen[slot] = true;
+					}
 					break;
 					
 				case PRU_ESTOP:
@@ -861,10 +1038,11 @@ void spi_read()
 				default:
 					// we have received a BAD payload from the PRU
 					*(data->SPIstatus) = 0;
+					frameSize = 0;
 
-					rtapi_print("Bad SPI payload = %x\n", rxData.header);
+					rtapi_print("Bad SPI payload = %x\n", rxHeader->header);
 					//for (i = 0; i < SPIBUFSIZE; i++) {
-					//	rtapi_print("%d\n",rxData.rxBuffer[i]);
+					//	rtapi_print("%d\n",((uint8_t *)rxFrame)[i]);
 					//}
 					break;
 			}
@@ -879,76 +1057,48 @@ void spi_read()
 }
 
 
-void spi_write()
+void spi_transfer(int length)
 {
-	int i;
-
-	// Data header
-	txData.header = PRU_WRITE;
+	spi_frame_t frame = { txFrame, rxFrame, length };
 
-	// Joint frequency commands
-	for (i = 0; i < JOINTS; i++)
-	{
-		txData.jointFreqCmd[i] = data->freq[i];
-	}
+	// send and receive data to and from the Remora PRU concurrently
+	spi->transfer(&frame, 1);
+}
 
-	for (i = 0; i < JOINTS; i++)
-	{
-		if (*(data->stepperEnable[i]) == 1)
-		{
-			txData.jointEnable |= (1 << i);		
-		}
-		else
-		{
-			txData.jointEnable &= ~(1 << i);	
-		}
-	}
 
-	// Set points
-	for (i = 0; i < VARIABLES; i++)
-	{
-		txData.setPoint[i] = *(data->setPoint[i]);
-	}
+// CRC-32 as calculated by the STM32 CRC unit: polynomial 0x04C11DB7, initial value 0xFFFFFFFF,
+// a word at a time MSB first, no reflection and no final XOR
+static void crc_init(void)
+{
+	int i, bit;
+	uint32_t crc;
 
-	// Outputs
-	for (i = 0; i < DIGITAL_OUTPUTS; i++)
+	for (i = 0; i < 256; i++)
 	{
-		if (*(data->outputs[i]) == 1)
-		{
-			txData.outputs |= (1 << i);		// output is high
-		}
-		else
+		crc = (uint32_t)i << 24;
+		for (bit = 0; bit < 8; bit++)
 		{
-			txData.outputs &= ~(1 << i);	// output is low
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
 		}
+		crcTable[i] = crc;
 	}
-
-	if( *(data->SPIstatus) )
-	{
-		// Transfer to and from the PRU
-		spi_transfer();
-	}
-
 }
 
-
-void spi_transfer()
+static uint32_t frame_crc(const uint32_t *data, int words)
 {
-	// send and receive data to and from the Remora PRU concurrently
-
-#ifdef TARGET_LPC
-	int i;
+	uint32_t crc = 0xFFFFFFFF;
+	uint32_t word;
 
-	for (i = 0; i < SPIBUFSIZE; i++)
+	while (words--)
 	{
-		rxData.rxBuffer[i] = bcm2835_spi_transfer(txData.txBuffer[i]);
+		word = *data++;
+		crc = (crc << 8) ^ crcTable[(crc >> 24) ^ (word >> 24)];
+		crc = (crc << 8) ^ crcTable[(crc >> 24) ^ ((word >> 16) & 0xFF)];
+		crc = (crc << 8) ^ crcTable[(crc >> 24) ^ ((word >> 8) & 0xFF)];
+		crc = (crc << 8) ^ crcTable[(crc >> 24) ^ (word & 0xFF)];
 	}
-#endif
-	
-#ifdef TARGET_STM32
-	bcm2835_spi_transfernb(txData.txBuffer, rxData.rxBuffer, SPIBUFSIZE);
-#endif
 
+	return crc;
 }
 
 static CONTROL parse_ctrl_type(const char *ctrl)
@@ -957,3 +1107,11 @@ static CONTROL parse_ctrl_type(const char *ctrl)
     if(*ctrl == 'v' || *ctrl == 'V') return VELOCITY;
     return INVALID;
 }
+
+static transport_t *parse_transport(const char *name)
+{
+	if (!name || !*name || !strcmp(name, "bcm2835")) return &bcm2835_transport;
+	if (!strcmp(name, "spidev")) return &spidev_transport;
+	if (!strcmp(name, "loopback")) return &loopback_transport;
+	return NULL;
+}
@@ -8,7 +8,52 @@
 #define DIGITAL_OUTPUTS		8
 #define DIGITAL_INPUTS		8
 
-#define SPIBUFSIZE			64 			//(4+4*JOINTS+4*COMMANDS+1) //(MAX_MSG*4) //20  SPI buffer size ......FIFO buffer size is 64 bytes?
+// SPI frame, the same as the Remora firmware remora.h
+//
+//   int32_t    header                  PRU_READ, PRU_WRITE, PRU_DATA or PRU_ESTOP
+//   uint8_t    version                 REMORA_FRAME_VERSION
+//   uint8_t    sequence                incremented by the sender for every frame
+//   uint8_t    joints                  layout descriptor
+//   uint8_t    variables
+//   int32_t    joint[joints]           jointFreqCmd / jointFeedback
+//   int32_t    position[joints]        jointPosCmd / 0
+//   float      variable[variables]     setPoint / processVariable
+//   uint8_t    bits[4]                 jointEnable, outputs / inputs
+//   uint32_t   timestamp               0 / PRU microsecond time of the last WRITE received
+//   uint32_t   timing                  0 / one slot of the PRU frame timing statistics
+//   uint32_t   crc                     CRC-32 of the preceding words, as the STM32 CRC unit
+//
+// The PRU sends only the joints and variables its configuration uses. The layout is read from
+// the PRU's first frame and the frame size agreed from it.
+//
+// A WRITE gives each joint a step rate and the position, in DDS counts wrapping at 32 bits like
+// the feedback, the joint should reach when the next WRITE is due. A Stepgen configured with
+// "Interpolation" moves to the position over the period, the others run at the rate.
+//
+// The timing word holds the slot number in the top byte and the low 24 bits of its count, one
+// slot per frame in turn. Slot n of the FRAME_HIST_BINS counts the WRITE intervals that differ
+// from the mean by 2^(n-1) to 2^n - 1 us (0 us for slot 0, the last slot also larger ones), and
+// FRAME_SLOT_MISSED counts the frames the PRU lost or rejected.
+
+#define REMORA_FRAME_VERSION	4
+#define FRAME_SIZE(j, v)		(24 + 4 * (2 * (j) + (v)))	// bytes, always a whole number of words
+#define FRAME_WORDS(j, v)		(FRAME_SIZE(j, v) / 4)
+
+#define FRAME_HIST_BINS			12
+#define FRAME_SLOT_MISSED		FRAME_HIST_BINS
+#define FRAME_SLOTS				(FRAME_HIST_BINS + 1)
+#define FRAME_COUNT_MASK		0x00FFFFFF
+
+#define SPIBUFSIZE			FRAME_SIZE(JOINTS, VARIABLES)	// largest frame, used to read the layout
+
+typedef struct
+{
+	int32_t header;
+	uint8_t version;
+	uint8_t sequence;
+	uint8_t joints;
+	uint8_t variables;
+} frameHeader_t;
 
 #define PRU_DATA			0x64617461 	// "data" SPI payload
 #define PRU_READ          	0x72656164  // "read" SPI payload
@@ -19,7 +64,10 @@
 #define STEP_MASK			(1L<<STEPBIT)
 #define STEP_OFFSET			(1L<<(STEPBIT-1))
 
-#define PRU_BASEFREQ		40000 		// Base freq of the PRU stepgen in Hz
+#ifndef PRU_BASEFREQ
+#define PRU_BASEFREQ		40000 		// Base freq of the PRU stepgen in Hz - set this the same as Remora firmware code!!!
+#endif
+#define PRU_DMAFREQ			400000 		// Output freq of the PRU DMA stepgen in Hz - set this the same as Remora firmware code!!!
 
 
 
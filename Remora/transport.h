@@ -0,0 +1,38 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+// SPI transport used by the remora component to exchange frames with the PRU
+//
+// Each backend is a set of functions behind transport_t, chosen at load time with the
+// "transport" module parameter. Like bcm2835.c the backends are included into remora.c, so
+// "halcompile --install remora.c" still builds a single file:
+//
+//   bcm2835    Raspberry Pi SPI0 register access, needs root
+//   spidev     Linux spidev device, any board with a kernel SPI driver
+//   loopback   in memory, frames are passed to loopback_pru() or returned as sent
+
+typedef struct
+{
+	const void	*tx;
+	void		*rx;
+	int			length;			// bytes
+} spi_frame_t;
+
+typedef struct
+{
+	const char	*name;
+	int			(*init)(void);									// 0 on success
+	void		(*transfer)(const spi_frame_t *frames, int count);	// one chip select per frame
+	void		(*reset)(int level);							// PRU reset output
+	void		(*exit)(void);
+} transport_t;
+
+extern transport_t bcm2835_transport;
+extern transport_t spidev_transport;
+extern transport_t loopback_transport;
+
+// the simulated PRU behind the loopback transport, full duplex in bytes. NULL returns the
+// frame sent, set it before the first transfer
+extern void (*loopback_pru)(const uint8_t *mosi, uint8_t *miso, int length);
+
+#endif
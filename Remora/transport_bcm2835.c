@@ -0,0 +1,269 @@
+/********************************************************************
+* Description:  transport_bcm2835.c
+*               Raspberry Pi SPI0 transport for remora.c, see transport.h
+*
+* License: GPL Version 2
+********************************************************************/
+
+#include <stdint.h>
+
+// Using BCM2835 driver library by Mike McCauley, why reinvent the wheel!
+// http://www.airspayce.com/mikem/bcm2835/index.html
+// Include these in the source directory when using "halcompile --install remora.c"
+#include "bcm2835.h"
+#include "bcm2835.c"
+
+#include "transport.h"
+
+
+static int reset_gpio_pin = 25;				// RPI GPIO pin number used to force watchdog reset of the PRU
+
+static int rt_bcm2835_init(void);
+
+
+static int bcm2835_transport_init(void)
+{
+	// Map the RPi BCM2835 peripherals - uses "rtapi_open_as_root" in place of "open"
+	if (!rt_bcm2835_init())
+    {
+      rtapi_print_msg(RTAPI_MSG_ERR,"rt_bcm2835_init failed. Are you running with root privlages??\n");
+      return -1;
+    }
+
+	// Set the SPI0 pins to the Alt 0 function to enable SPI0 access, setup CS register
+	// and clear TX and RX fifos
+	if (!bcm2835_spi_begin())
+    {
+      rtapi_print_msg(RTAPI_MSG_ERR,"bcm2835_spi_begin failed. Are you running with root privlages??\n");
+      return -1;
+    }
+
+	// Configure SPI0
+	bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);      // The default
+	bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);                   // The default
+
+	//bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_128);		// 3.125MHz on RPI3
+	//bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_64);		// 6.250MHz on RPI3 <- LPC1768 setting
+	//bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_32);		// 12.5MHz on RPI3
+	bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_16);		// 25MHz on RPI3    <- STM32F4 setting
+	//bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_8);	// fail....
+
+    bcm2835_spi_chipSelect(BCM2835_SPI_CS0);                      // The default
+    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);      // the default
+
+
+	/* RPI_GPIO_P1_19        = 10 		MOSI when SPI0 in use
+     * RPI_GPIO_P1_21        =  9 		MISO when SPI0 in use
+     * RPI_GPIO_P1_23        = 11 		CLK when SPI0 in use
+     * RPI_GPIO_P1_24        =  8 		CE0 when SPI0 in use
+     * RPI_GPIO_P1_26        =  7 		CE1 when SPI0 in use
+	 */
+
+	// Configure pullups on SPI0 pins - source termination and CS high (does this allows for higher clock frequencies??? wiring is more important here)
+	bcm2835_gpio_set_pud(RPI_GPIO_P1_19, BCM2835_GPIO_PUD_DOWN);	// MOSI
+	bcm2835_gpio_set_pud(RPI_GPIO_P1_21, BCM2835_GPIO_PUD_DOWN);	// MISO
+	bcm2835_gpio_set_pud(RPI_GPIO_P1_24, BCM2835_GPIO_PUD_UP);		// CS0
+
+	bcm2835_gpio_fsel(reset_gpio_pin, BCM2835_GPIO_FSEL_OUTP);
+
+	return 0;
+}
+
+
+static void bcm2835_transport_transfer(const spi_frame_t *frames, int count)
+{
+	// send and receive data to and from the Remora PRU concurrently
+	for (; count > 0; count--, frames++)
+	{
+#ifdef TARGET_LPC
+		int i;
+
+		for (i = 0; i < frames->length; i++)
+		{
+			((uint8_t *)frames->rx)[i] = bcm2835_spi_transfer(((const uint8_t *)frames->tx)[i]);
+		}
+#endif
+
+#ifdef TARGET_STM32
+		bcm2835_spi_transfernb((char *)frames->tx, (char *)frames->rx, frames->length);
+#endif
+	}
+}
+
+
+static void bcm2835_transport_reset(int level)
+{
+	if (level)
+	{
+		bcm2835_gpio_set(reset_gpio_pin);
+	}
+	else
+	{
+		bcm2835_gpio_clr(reset_gpio_pin);
+	}
+}
+
+
+static void bcm2835_transport_exit(void)
+{
+	bcm2835_spi_end();
+	bcm2835_close();
+}
+
+
+transport_t bcm2835_transport = {
+	"bcm2835",
+	bcm2835_transport_init,
+	bcm2835_transport_transfer,
+	bcm2835_transport_reset,
+	bcm2835_transport_exit
+};
+
+
+// This is the same as the standard bcm2835 library except for the use of
+// "rtapi_open_as_root" in place of "open"
+
+static int rt_bcm2835_init(void)
+{
+    int  memfd;
+    int  ok;
+    FILE *fp;
+
+    if (debug) 
+    {
+        bcm2835_peripherals = (uint32_t*)BCM2835_PERI_BASE;
+
+	bcm2835_pads = bcm2835_peripherals + BCM2835_GPIO_PADS/4;
+	bcm2835_clk  = bcm2835_peripherals + BCM2835_CLOCK_BASE/4;
+	bcm2835_gpio = bcm2835_peripherals + BCM2835_GPIO_BASE/4;
+	bcm2835_pwm  = bcm2835_peripherals + BCM2835_GPIO_PWM/4;
+	bcm2835_spi0 = bcm2835_peripherals + BCM2835_SPI0_BASE/4;
+	bcm2835_bsc0 = bcm2835_peripherals + BCM2835_BSC0_BASE/4;
+	bcm2835_bsc1 = bcm2835_peripherals + BCM2835_BSC1_BASE/4;
+	bcm2835_st   = bcm2835_peripherals + BCM2835_ST_BASE/4;
+	bcm2835_aux  = bcm2835_peripherals + BCM2835_AUX_BASE/4;
+	bcm2835_spi1 = bcm2835_peripherals + BCM2835_SPI1_BASE/4;
+
+	return 1; /* Success */
+    }
+
+    /* Figure out the base and size of the peripheral address block
+    // using the device-tree. Required for RPi2/3/4, optional for RPi 1
+    */
+    if ((fp = fopen(BMC2835_RPI2_DT_FILENAME , "rb")))
+    {
+        unsigned char buf[16];
+        uint32_t base_address;
+        uint32_t peri_size;
+        if (fread(buf, 1, sizeof(buf), fp) >= 8)
+        {
+            base_address = (buf[4] << 24) |
+              (buf[5] << 16) |
+              (buf[6] << 8) |
+              (buf[7] << 0);
+            
+            peri_size = (buf[8] << 24) |
+              (buf[9] << 16) |
+              (buf[10] << 8) |
+              (buf[11] << 0);
+            
+            if (!base_address)
+            {
+                /* looks like RPI 4 */
+                base_address = (buf[8] << 24) |
+                      (buf[9] << 16) |
+                      (buf[10] << 8) |
+                      (buf[11] << 0);
+                      
+                peri_size = (buf[12] << 24) |
+                (buf[13] << 16) |
+                (buf[14] << 8) |
+                (buf[15] << 0);
+            }
+            /* check for valid known range formats */
+            if ((buf[0] == 0x7e) &&
+                    (buf[1] == 0x00) &&
+                    (buf[2] == 0x00) &&
+                    (buf[3] == 0x00) &&
+                    ((base_address == BCM2835_PERI_BASE) || (base_address == BCM2835_RPI2_PERI_BASE) || (base_address == BCM2835_RPI4_PERI_BASE)))
+            {
+                bcm2835_peripherals_base = (off_t)base_address;
+                bcm2835_peripherals_size = (size_t)peri_size;
+                if( base_address == BCM2835_RPI4_PERI_BASE )
+                {
+                    pud_type_rpi4 = 1;
+                }
+            }
+        
+        }
+        
+	fclose(fp);
+    }
+    /* else we are prob on RPi 1 with BCM2835, and use the hardwired defaults */
+
+    /* Now get ready to map the peripherals block 
+     * If we are not root, try for the new /dev/gpiomem interface and accept
+     * the fact that we can only access GPIO
+     * else try for the /dev/mem interface and get access to everything
+     */
+    memfd = -1;
+    ok = 0;
+    if (geteuid() == 0)
+    {
+      /* Open the master /dev/mem device */
+      if ((memfd = rtapi_open_as_root("/dev/mem", O_RDWR | O_SYNC) ) < 0) 
+	{
+	  fprintf(stderr, "bcm2835_init: Unable to open /dev/mem: %s\n",
+		  strerror(errno)) ;
+	  goto exit;
+	}
+      
+      /* Base of the peripherals block is mapped to VM */
+      bcm2835_peripherals = mapmem("gpio", bcm2835_peripherals_size, memfd, bcm2835_peripherals_base);
+      if (bcm2835_peripherals == MAP_FAILED) goto exit;
+      
+      /* Now compute the base addresses of various peripherals, 
+      // which are at fixed offsets within the mapped peripherals block
+      // Caution: bcm2835_peripherals is uint32_t*, so divide offsets by 4
+      */
+      bcm2835_gpio = bcm2835_peripherals + BCM2835_GPIO_BASE/4;
+      bcm2835_pwm  = bcm2835_peripherals + BCM2835_GPIO_PWM/4;
+      bcm2835_clk  = bcm2835_peripherals + BCM2835_CLOCK_BASE/4;
+      bcm2835_pads = bcm2835_peripherals + BCM2835_GPIO_PADS/4;
+      bcm2835_spi0 = bcm2835_peripherals + BCM2835_SPI0_BASE/4;
+      bcm2835_bsc0 = bcm2835_peripherals + BCM2835_BSC0_BASE/4; /* I2C */
+      bcm2835_bsc1 = bcm2835_peripherals + BCM2835_BSC1_BASE/4; /* I2C */
+      bcm2835_st   = bcm2835_peripherals + BCM2835_ST_BASE/4;
+      bcm2835_aux  = bcm2835_peripherals + BCM2835_AUX_BASE/4;
+      bcm2835_spi1 = bcm2835_peripherals + BCM2835_SPI1_BASE/4;
+
+      ok = 1;
+    }
+    else
+    {
+      /* Not root, try /dev/gpiomem */
+      /* Open the master /dev/mem device */
+      if ((memfd = open("/dev/gpiomem", O_RDWR | O_SYNC) ) < 0) 
+	{
+	  fprintf(stderr, "bcm2835_init: Unable to open /dev/gpiomem: %s\n",
+		  strerror(errno)) ;
+	  goto exit;
+	}
+      
+      /* Base of the peripherals block is mapped to VM */
+      bcm2835_peripherals_base = 0;
+      bcm2835_peripherals = mapmem("gpio", bcm2835_peripherals_size, memfd, bcm2835_peripherals_base);
+      if (bcm2835_peripherals == MAP_FAILED) goto exit;
+      bcm2835_gpio = bcm2835_peripherals;
+      ok = 1;
+    }
+
+exit:
+    if (memfd >= 0)
+        close(memfd);
+
+    if (!ok)
+	bcm2835_close();
+
+    return ok;
+}
@@ -0,0 +1,60 @@
+/********************************************************************
+* Description:  transport_loopback.c
+*               In memory transport for remora.c, see transport.h
+*
+*               Runs the driver without SPI hardware, against a simulated
+*               PRU or with every frame returned as sent.
+*
+* License: GPL Version 2
+********************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "transport.h"
+
+
+void (*loopback_pru)(const uint8_t *mosi, uint8_t *miso, int length) = NULL;
+
+
+static int loopback_transport_init(void)
+{
+	rtapi_print_msg(RTAPI_MSG_INFO, "loopback: %s\n", loopback_pru ? "simulated PRU" : "frames returned as sent");
+	return 0;
+}
+
+
+static void loopback_transport_transfer(const spi_frame_t *frames, int count)
+{
+	for (; count > 0; count--, frames++)
+	{
+		if (loopback_pru)
+		{
+			loopback_pru((const uint8_t *)frames->tx, (uint8_t *)frames->rx, frames->length);
+		}
+		else
+		{
+			memmove(frames->rx, frames->tx, frames->length);
+		}
+	}
+}
+
+
+static void loopback_transport_reset(int level)
+{
+	(void)level;
+}
+
+
+static void loopback_transport_exit(void)
+{
+}
+
+
+transport_t loopback_transport = {
+	"loopback",
+	loopback_transport_init,
+	loopback_transport_transfer,
+	loopback_transport_reset,
+	loopback_transport_exit
+};
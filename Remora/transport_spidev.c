@@ -0,0 +1,130 @@
+/********************************************************************
+* Description:  transport_spidev.c
+*               Linux spidev transport for remora.c, see transport.h
+*
+* License: GPL Version 2
+********************************************************************/
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "transport.h"
+
+#define SPIDEV_MAX_FRAMES	4			// frames in one SPI_IOC_MESSAGE
+
+
+static const char	*spidev_path = "/dev/spidev0.0";
+static uint32_t		spidev_speed = 25000000;	// Hz, the STM32F4 setting
+static const char	*spidev_reset_path = "";	// sysfs GPIO value file for the PRU reset, "" for none
+
+static int			spidev_fd = -1;
+static int			spidev_reset_fd = -1;
+static int			spidev_reset_level = -1;
+
+
+static int spidev_transport_init(void)
+{
+	uint8_t mode = SPI_MODE_0;
+	uint8_t bits = 8;
+
+	spidev_fd = open(spidev_path, O_RDWR);
+	if (spidev_fd < 0)
+	{
+		rtapi_print_msg(RTAPI_MSG_ERR, "spidev: unable to open %s: %s\n", spidev_path, strerror(errno));
+		return -1;
+	}
+
+	if (ioctl(spidev_fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+		ioctl(spidev_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+		ioctl(spidev_fd, SPI_IOC_WR_MAX_SPEED_HZ, &spidev_speed) < 0)
+	{
+		rtapi_print_msg(RTAPI_MSG_ERR, "spidev: unable to configure %s: %s\n", spidev_path, strerror(errno));
+		close(spidev_fd);
+		spidev_fd = -1;
+		return -1;
+	}
+
+	// the reset output is optional, spidev has no GPIO of its own
+	if (spidev_reset_path && *spidev_reset_path)
+	{
+		spidev_reset_fd = open(spidev_reset_path, O_WRONLY);
+		if (spidev_reset_fd < 0)
+		{
+			rtapi_print_msg(RTAPI_MSG_ERR, "spidev: unable to open %s: %s\n", spidev_reset_path, strerror(errno));
+			close(spidev_fd);
+			spidev_fd = -1;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+static void spidev_transport_transfer(const spi_frame_t *frames, int count)
+{
+	struct spi_ioc_transfer xfer[SPIDEV_MAX_FRAMES];
+	int i, n;
+
+	// up to SPIDEV_MAX_FRAMES frames go to the kernel in one SPI_IOC_MESSAGE, chip select is
+	// released between them
+	while (count > 0)
+	{
+		n = count < SPIDEV_MAX_FRAMES ? count : SPIDEV_MAX_FRAMES;
+		memset(xfer, 0, sizeof(xfer));
+
+		for (i = 0; i < n; i++)
+		{
+			xfer[i].tx_buf = (unsigned long)frames[i].tx;
+			xfer[i].rx_buf = (unsigned long)frames[i].rx;
+			xfer[i].len = frames[i].length;
+			xfer[i].speed_hz = spidev_speed;
+			xfer[i].bits_per_word = 8;
+			xfer[i].cs_change = (i < n - 1);
+		}
+
+		if (ioctl(spidev_fd, SPI_IOC_MESSAGE(n), xfer) < 0)
+		{
+			// the frames are left as they were, the header check rejects them
+			rtapi_print("spidev: transfer failed: %s\n", strerror(errno));
+		}
+
+		frames += n;
+		count -= n;
+	}
+}
+
+
+static void spidev_transport_reset(int level)
+{
+	// only written when the level changes, each write is a system call
+	if (spidev_reset_fd < 0 || level == spidev_reset_level) return;
+
+	if (write(spidev_reset_fd, level ? "1" : "0", 1) == 1)
+	{
+		spidev_reset_level = level;
+	}
+}
+
+
+static void spidev_transport_exit(void)
+{
+	if (spidev_reset_fd >= 0) close(spidev_reset_fd);
+	if (spidev_fd >= 0) close(spidev_fd);
+	spidev_reset_fd = -1;
+	spidev_fd = -1;
+}
+
+
+transport_t spidev_transport = {
+	"spidev",
+	spidev_transport_init,
+	spidev_transport_transfer,
+	spidev_transport_reset,
+	spidev_transport_exit
+};
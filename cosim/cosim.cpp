@@ -0,0 +1,518 @@
+// Closed loop co-simulation of the remora LinuxCNC component and the Remora PRU firmware
+//
+// The host driver, Remora/remora.c, runs unmodified against the minimal HAL in halsim.c, with
+// the loopback transport. Its frames go in memory to the simulated PRU of
+// OS5-SKRv2-Remora/TARGET_SIM, where Stepgen modules run in the Base thread at PRU_BASEFREQ.
+// A joint trajectory is replayed as pos-cmd, one line per servo period, and the position
+// feedback is compared with it.
+//
+// Build with the CMakeLists.txt at the top of the repository, ctest runs it as a regression check:
+//
+//   cmake -S . -B build && cmake --build build --target cosim && ctest --test-dir build
+//
+// The Base thread frequency is a build setting of both sides, configure with -DPRU_BASEFREQ=<Hz>
+// to compare another one. The servo period, packet loss and the rest are options:
+//
+//   cosim [-t file] [-j joints] [-p period ns] [-l loss] [-s scale] [-a accel] [-f ff2gain] [-c Hz]
+//         [-J jitter us] [-P ppm] [-d decel] [-o period] [-e rms] [-i] [-x] [-v]
+//
+//   -t   trajectory, whitespace separated joint positions per line as written by halsampler,
+//        relative to the first line. Without it each joint makes a series of trapezoidal moves
+//   -j   joints for the built in trajectory, default 3
+//   -p   servo period in ns, default 1000000
+//   -l   probability of losing a command frame on its way to the PRU, default 0
+//   -s   joint scale in steps per unit, default 100
+//   -a   joint maxaccel in units/s^2, default 2000
+//   -f   joint ff2gain in seconds, default 0
+//   -c   joint cmd-filter cutoff in Hz, default 0 for none
+//   -J   servo thread start jitter, each period starts up to this many us late, default 0
+//   -P   PRU clock error against the host in ppm, default 0
+//   -d   Stepgen deceleration to a stop when the commands stop, in units/s^2, default 0 to run on
+//   -o   cut the comms from this servo period to the end of the run, default 0 for never
+//   -e   exit with status 2 if the SPI link is lost or any joint's ferror rms is above this,
+//        default 0 for no check
+//   -i   Stepgens interpolate to the position setpoint, "Interpolation":"Position"
+//   -x   use remora.exchange in place of remora.read and remora.write
+//   -r   random seed for the packet loss, default 1
+//   -v   print the driver's information messages
+//
+// The report gives, per joint, the following error (pos-cmd - pos-fb of the same period), the
+// pipeline delay that best lines the feedback up with the command and the error left after
+// that delay, and the step rate reached against the max-freq ceiling. The PRU's view of the
+// frame timing, read back through the SPI-jitter and SPI-missed pins, follows, and the phase of
+// the WRITE frames in the Base period over the second half of the run. With -o, the step rate
+// of each joint when the comms are cut and how long and how far it runs on after.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "stm32f4xx_hal.h"
+#include "simulator.h"
+#include "halsim.h"
+
+extern "C"
+{
+    int rtapi_app_main(void);
+    extern char* transport;
+    extern void (*loopback_pru)(const uint8_t* mosi, uint8_t* miso, int length);
+}
+
+#define MAX_LAG         20          // servo periods searched for the pipeline delay
+#define SETTLE_PERIODS  200         // periods held at the end of the trajectory
+
+
+/***********************************************************************
+        STRUCTURES AND GLOBAL VARIABLES
+************************************************************************/
+
+typedef struct
+{
+    const char* trajectoryFile;
+    int         joints;
+    long        periodNs;
+    double      loss;
+    double      scale;
+    double      maxAccel;
+    double      ff2gain;
+    double      cmdFilter;
+    uint32_t    jitterUs;
+    int32_t     clockPpm;
+    double      decel;
+    long        outage;
+    bool        interpolate;
+    bool        exchange;
+    uint32_t    seed;
+    double      maxRms;
+} options_t;
+
+typedef struct
+{
+    std::vector<double> cmd;        // pos-cmd per servo period
+    std::vector<double> fb;         // pos-fb read in the same period
+    std::vector<double> freq;       // freq-cmd sent to the PRU
+    std::vector<int64_t> steps;     // Stepgen position in the PRU, in steps
+    int64_t position;               // the DDS position feedback, extended past its 32 bits
+    int32_t lastFeedback;
+} jointLog_t;
+
+static uint32_t randomState;
+static double   lossProbability;
+static uint32_t framesSent;
+static uint32_t framesLost;
+static std::vector<uint32_t> writePhase;    // Base timer count when each WRITE goes out
+static bool     commsCut;
+
+extern volatile txData_t txData;
+
+
+/***********************************************************************
+        ROUTINES
+************************************************************************/
+
+static uint32_t nextRandom()
+{
+    // xorshift32, repeatable for a given seed
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+
+static void lossyTransfer(const uint8_t* mosi, uint8_t* miso, int length)
+{
+    uint8_t frame[256];
+
+    // a cut leaves the PRU without frames, the host reads back nothing
+    if (commsCut)
+    {
+        memset(miso, 0, length);
+        framesSent++;
+        framesLost++;
+        return;
+    }
+
+    // a lost frame arrives with a corrupt payload, the PRU rejects it and still answers
+    memcpy(frame, mosi, length);
+    framesSent++;
+
+    if (lossProbability > 0.0 && (nextRandom() / 4294967296.0) < lossProbability && length > 8)
+    {
+        frame[8] ^= 0xFF;
+        framesLost++;
+    }
+
+    simTransfer(frame, miso, length);
+}
+
+
+static std::string pruConfig(const options_t& opt)
+{
+    std::string json = "{\"Modules\":[";
+    char buf[256];
+
+    for (int j = 0; j < opt.joints; j++)
+    {
+        snprintf(buf, sizeof(buf),
+            "%s{\"Thread\":\"Base\",\"Type\":\"Stepgen\",\"Comment\":\"Joint %d\",\"Joint Number\":%d,"
+            "\"Step Pin\":\"PA_%d\",\"Direction Pin\":\"PA_%d\",\"Enable Pin\":\"PB_%d\","
+            "\"Comms Loss Decel\":%.0f%s}",
+            j ? "," : "", j, j, 2 * j, 2 * j + 1, j, fabs(opt.decel * opt.scale),
+            opt.interpolate ? ",\"Interpolation\":\"Position\"" : "");
+        json += buf;
+    }
+
+    return json + "]}";
+}
+
+
+static bool loadTrajectory(const char* file, std::vector<std::vector<double> >& traj)
+{
+    FILE* f = fopen(file, "r");
+    char line[1024];
+
+    if (f == NULL) return false;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        std::vector<double> point;
+        char* p = line;
+        char* end;
+
+        if (line[0] == '#') continue;
+
+        for (double v = strtod(p, &end); end != p && point.size() < JOINTS; v = strtod(p, &end))
+        {
+            point.push_back(v);
+            p = end;
+        }
+
+        if (!point.empty()) traj.push_back(point);
+    }
+
+    fclose(f);
+    return !traj.empty();
+}
+
+
+static void builtinTrajectory(const options_t& opt, std::vector<std::vector<double> >& traj)
+{
+    // trapezoidal moves of 50 units at up to 150 units/s, each joint with its own accel
+    const double dt = opt.periodNs * 1e-9;
+    const double distance = 50.0;
+    const double vmax = 150.0;
+
+    std::vector<double> pos(opt.joints, 0.0), vel(opt.joints, 0.0), target(opt.joints, distance);
+    std::vector<int> moves(opt.joints, 0);
+    int done = 0;
+
+    // four moves per joint, a joint that has made them waits for the others
+    while (done < opt.joints)
+    {
+        std::vector<double> point(opt.joints);
+
+        for (int j = 0; j < opt.joints; j++)
+        {
+            point[j] = pos[j];
+            if (moves[j] == 4) continue;
+
+            double accel = opt.maxAccel * (0.5 + 0.5 * j / (double)opt.joints);
+            double remaining = target[j] - pos[j];
+            double dir = remaining >= 0 ? 1.0 : -1.0;
+            double stopping = vel[j] * vel[j] / (2.0 * accel);
+
+            if (fabs(remaining) <= stopping) vel[j] -= dir * accel * dt;
+            else if (fabs(vel[j]) < vmax) vel[j] += dir * accel * dt;
+
+            if (fabs(vel[j]) > vmax) vel[j] = dir * vmax;
+            pos[j] += vel[j] * dt;
+
+            // arrived, turn round
+            if ((dir > 0 && pos[j] >= target[j]) || (dir < 0 && pos[j] <= target[j]) ||
+                (fabs(remaining) < 1e-3 && fabs(vel[j]) <= accel * dt))
+            {
+                pos[j] = target[j];
+                vel[j] = 0.0;
+                target[j] = target[j] > 0 ? 0.0 : distance;
+                if (++moves[j] == 4) done++;
+            }
+
+            point[j] = pos[j];
+        }
+
+        traj.push_back(point);
+    }
+}
+
+
+static bool* bitPin(const char* name, int joint)
+{
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), name, joint);
+    return (bool*)halsim_pin(buf);
+}
+
+static double* floatPin(const char* name, int joint)
+{
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), name, joint);
+    return (double*)halsim_pin(buf);
+}
+
+
+static double report(const options_t& opt, std::vector<jointLog_t>& log, double maxFreq)
+{
+    const double dt = opt.periodNs * 1e-9;
+    double worstRms = 0;
+    simThreadStats_t base = simGetStats(0);
+    simThreadStats_t servo = simGetStats(1);
+    uint32_t seqErrors = *(uint32_t*)halsim_pin("remora.SPI-seq-errors");
+
+    printf("\nservo period %ld ns, Base thread %d Hz, %s%s\n", opt.periodNs, PRU_BASEFREQ,
+        opt.exchange ? "exchange" : "read/write", opt.interpolate ? ", position interpolation" : "");
+    printf("frames %u, lost %u (%.3f%%), sequence errors %u\n", framesSent, framesLost,
+        framesSent ? 100.0 * framesLost / framesSent : 0.0, seqErrors);
+    printf("PRU Base thread %.0f ns mean, %llu ns max   Servo thread %.0f ns mean, %llu ns max (host time)\n",
+        base.ticks ? (double)base.totalNs / base.ticks : 0.0, (unsigned long long)base.maxNs,
+        servo.ticks ? (double)servo.totalNs / servo.ticks : 0.0, (unsigned long long)servo.maxNs);
+
+    printf("\njoint  ferror max   ferror rms   delay      rms after delay   peak step rate   at max-freq\n");
+
+    for (size_t j = 0; j < log.size(); j++)
+    {
+        jointLog_t& l = log[j];
+        size_t n = l.cmd.size();
+        double maxErr = 0, sumErr = 0, peakRate = 0;
+        double bestRms = INFINITY;
+        int bestLag = 0, saturated = 0;
+
+        for (size_t k = 1; k < n; k++)
+        {
+            double e = l.cmd[k] - l.fb[k];
+
+            maxErr = fmax(maxErr, fabs(e));
+            sumErr += e * e;
+            peakRate = fmax(peakRate, fabs(l.fb[k] - l.fb[k - 1]) * opt.scale / dt);
+            if (fabs(l.freq[k]) >= maxFreq * 0.999) saturated++;
+        }
+
+        for (int lag = 0; lag <= MAX_LAG && (size_t)lag < n; lag++)
+        {
+            double sum = 0;
+
+            for (size_t k = lag; k < n; k++)
+            {
+                double e = l.cmd[k - lag] - l.fb[k];
+                sum += e * e;
+            }
+
+            sum = sqrt(sum / (n - lag));
+            if (sum < bestRms)
+            {
+                bestRms = sum;
+                bestLag = lag;
+            }
+        }
+
+        printf("%3zu    %10.5f   %10.5f   %5.2f ms   %10.5f        %8.0f Hz    %5d of %zu\n", j, maxErr,
+            sqrt(sumErr / (n - 1)), bestLag * dt * 1e3, bestRms, peakRate, saturated, n);
+        worstRms = fmax(worstRms, sqrt(sumErr / (n - 1)));
+    }
+
+    // bin n counts the WRITE intervals 2^(n-1) to 2^n - 1 us from the mean
+    printf("\nPRU frame timing: last interval %u us, missed %u\nintervals by difference from the mean, us:\n",
+        *(uint32_t*)halsim_pin("remora.SPI-frame-interval"), *(uint32_t*)halsim_pin("remora.SPI-missed"));
+
+    for (int i = 0; i < FRAME_HIST_BINS; i++)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "remora.SPI-jitter.%02d", i);
+        printf("  %s%u %u", i == FRAME_HIST_BINS - 1 ? ">=" : "<", i == FRAME_HIST_BINS - 1 ? 1u << (i - 1) : 1u << i,
+            *(uint32_t*)halsim_pin(name));
+    }
+    printf("\n");
+
+    // a free running Base thread sweeps through the period at the clock difference, a locked one
+    // holds the middle
+    uint32_t minPhase = UINT32_MAX, maxPhase = 0;
+
+    for (size_t k = writePhase.size() / 2; k < writePhase.size(); k++)
+    {
+        minPhase = std::min(minPhase, writePhase[k]);
+        maxPhase = std::max(maxPhase, writePhase[k]);
+    }
+    printf("WRITE phase in the Base period %u to %u of %u timer counts\n", minPhase, maxPhase, (unsigned)TIM9->ARR + 1);
+
+    if (opt.outage <= 0 || (size_t)opt.outage >= log[0].steps.size()) return worstRms;
+
+    // the run on after the last command the PRU latched
+    printf("\ncomms cut at %.1f ms, Comms Loss Decel %.0f steps/s^2\n", opt.outage * dt * 1e3, fabs(opt.decel * opt.scale));
+    printf("joint  step rate at cut   stopped after   steps after cut\n");
+
+    for (size_t j = 0; j < log.size(); j++)
+    {
+        std::vector<int64_t>& p = log[j].steps;
+        size_t k = opt.outage;
+        size_t last = k;
+
+        for (size_t i = k + 1; i < p.size(); i++)
+        {
+            if (p[i] != p[i - 1]) last = i;
+        }
+
+        printf("  %zu    %10.0f Hz       ", j, (p[k] - p[k - 1]) / dt);
+        if (last + 1 < p.size()) printf("%6.1f ms     ", (last - k) * dt * 1e3);
+        else printf("   running     ");
+        printf("%8lld\n", (long long)(p.back() - p[k]));
+    }
+
+    return worstRms;
+}
+
+
+int main(int argc, char** argv)
+{
+    options_t opt = { NULL, 3, 1000000, 0.0, 100.0, 2000.0, 0.0, 0.0, 0, 0, 0.0, 0, false, false, 1, 0.0 };
+    std::vector<std::vector<double> > traj;
+    std::vector<jointLog_t> log;
+    double maxFreq;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (!strcmp(arg, "-i")) { opt.interpolate = true; continue; }
+        if (!strcmp(arg, "-x")) { opt.exchange = true; continue; }
+        if (!strcmp(arg, "-v")) { halsim_verbose = 1; continue; }
+        if (val == NULL) { fprintf(stderr, "%s needs a value\n", arg); return 1; }
+
+        if (!strcmp(arg, "-t")) opt.trajectoryFile = val;
+        else if (!strcmp(arg, "-j")) opt.joints = atoi(val);
+        else if (!strcmp(arg, "-p")) opt.periodNs = atol(val);
+        else if (!strcmp(arg, "-l")) opt.loss = atof(val);
+        else if (!strcmp(arg, "-s")) opt.scale = atof(val);
+        else if (!strcmp(arg, "-a")) opt.maxAccel = atof(val);
+        else if (!strcmp(arg, "-f")) opt.ff2gain = atof(val);
+        else if (!strcmp(arg, "-c")) opt.cmdFilter = atof(val);
+        else if (!strcmp(arg, "-J")) opt.jitterUs = strtoul(val, NULL, 0);
+        else if (!strcmp(arg, "-P")) opt.clockPpm = atoi(val);
+        else if (!strcmp(arg, "-d")) opt.decel = atof(val);
+        else if (!strcmp(arg, "-o")) opt.outage = atol(val);
+        else if (!strcmp(arg, "-r")) opt.seed = strtoul(val, NULL, 0);
+        else if (!strcmp(arg, "-e")) opt.maxRms = atof(val);
+        else { fprintf(stderr, "unknown option %s\n", arg); return 1; }
+        i++;
+    }
+
+    if (opt.trajectoryFile)
+    {
+        if (!loadTrajectory(opt.trajectoryFile, traj))
+        {
+            fprintf(stderr, "unable to read %s\n", opt.trajectoryFile);
+            return 1;
+        }
+        opt.joints = traj[0].size();
+
+        // the simulated machine starts at 0, the trajectory is taken relative to its first line
+        for (size_t k = traj.size(); k-- > 0; )
+        {
+            traj[k].resize(opt.joints, 0.0);
+            for (int j = 0; j < opt.joints; j++) traj[k][j] -= traj[0][j];
+        }
+    }
+
+    if (opt.joints < 1 || opt.joints > JOINTS || opt.periodNs <= 0 || opt.scale == 0.0)
+    {
+        fprintf(stderr, "bad joints, period or scale\n");
+        return 1;
+    }
+
+    if (!opt.trajectoryFile) builtinTrajectory(opt, traj);
+
+    // the hold at the end shows the settling
+    for (int k = 0; k < SETTLE_PERIODS; k++) traj.push_back(traj.back());
+
+    randomState = opt.seed ? opt.seed : 1;
+    lossProbability = opt.loss;
+
+    // the PRU
+    simSetup();
+    simSetClockError(opt.clockPpm);
+    if (!simLoadModules(pruConfig(opt).c_str())) return 1;
+    simStartThreads();
+
+    // the host driver, over the loopback transport to the PRU
+    transport = (char*)"loopback";
+    loopback_pru = lossyTransfer;
+    if (rtapi_app_main() != 0) return 1;
+
+    *bitPin("remora.SPI-enable", 0) = true;
+    *bitPin("remora.SPI-reset", 0) = true;
+
+    for (int j = 0; j < opt.joints; j++)
+    {
+        *floatPin("remora.joint.%d.scale", j) = opt.scale;
+        *floatPin("remora.joint.%d.maxaccel", j) = opt.maxAccel * 2.0;
+        *floatPin("remora.joint.%d.ff2gain", j) = opt.ff2gain;
+        *floatPin("remora.joint.%d.cmd-filter", j) = opt.cmdFilter;
+        *bitPin("remora.joint.%d.enable", j) = true;
+        *floatPin("remora.joint.%d.pos-cmd", j) = traj[0][j];
+    }
+
+    maxFreq = *floatPin("remora.joint.%d.max-freq", 0);
+    log.resize(opt.joints);
+
+    // one HAL servo thread period per trajectory point
+    for (size_t k = 0; k < traj.size(); k++)
+    {
+        simRunUntil(k * (uint64_t)opt.periodNs + (opt.jitterUs ? (nextRandom() % (opt.jitterUs + 1)) * 1000 : 0));
+        if (opt.outage > 0 && k == (size_t)opt.outage) commsCut = true;
+        writePhase.push_back((uint32_t)TIM9->CNT);
+
+        if (opt.exchange) halsim_call("remora.exchange", opt.periodNs);
+        else halsim_call("remora.read", opt.periodNs);
+
+        for (int j = 0; j < opt.joints; j++)
+        {
+            *floatPin("remora.joint.%d.pos-cmd", j) = traj[k][j];
+        }
+
+        halsim_call("remora.update-freq", opt.periodNs);
+        if (!opt.exchange) halsim_call("remora.write", opt.periodNs);
+
+        for (int j = 0; j < opt.joints; j++)
+        {
+            log[j].cmd.push_back(traj[k][j]);
+            log[j].fb.push_back(*floatPin("remora.joint.%d.pos-fb", j));
+            log[j].freq.push_back(*floatPin("remora.joint.%d.freq-cmd", j));
+            log[j].position += (int32_t)(txData.jointFeedback[j] - log[j].lastFeedback);
+            log[j].lastFeedback = txData.jointFeedback[j];
+            log[j].steps.push_back(log[j].position >> STEPBIT);
+        }
+
+        if (k == 0) simResetStats();
+    }
+
+    bool linkLost = !*bitPin("remora.SPI-status", 0);
+    if (linkLost) printf("SPI status lost\n");
+
+    double worstRms = report(opt, log, maxFreq);
+
+    // as a regression check, the run fails on a lost link or a following error over the limit
+    if (opt.maxRms > 0 && (linkLost || worstRms > opt.maxRms))
+    {
+        printf("\nFAIL: ferror rms %.5f, limit %.5f\n", worstRms, opt.maxRms);
+        return 2;
+    }
+
+    return 0;
+}
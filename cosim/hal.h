@@ -0,0 +1,49 @@
+#ifndef HAL_H
+#define HAL_H
+
+// Stand-in for the LinuxCNC HAL header, only what remora.c uses. See halsim.h
+
+#include "rtapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HAL_NAME_LEN		47
+
+typedef volatile bool		hal_bit_t;
+typedef volatile double		hal_float_t;
+typedef volatile int32_t	hal_s32_t;
+typedef volatile uint32_t	hal_u32_t;
+
+typedef enum
+{
+	HAL_IN = 16,
+	HAL_OUT = 32,
+	HAL_IO = (HAL_IN | HAL_OUT)
+} hal_pin_dir_t;
+
+typedef enum
+{
+	HAL_RO = 64,
+	HAL_RW = 192
+} hal_param_dir_t;
+
+int hal_init(const char *name);
+int hal_exit(int comp_id);
+int hal_ready(int comp_id);
+void *hal_malloc(long size);
+
+int hal_pin_bit_newf(hal_pin_dir_t dir, hal_bit_t **data_ptr_addr, int comp_id, const char *fmt, ...);
+int hal_pin_float_newf(hal_pin_dir_t dir, hal_float_t **data_ptr_addr, int comp_id, const char *fmt, ...);
+int hal_pin_s32_newf(hal_pin_dir_t dir, hal_s32_t **data_ptr_addr, int comp_id, const char *fmt, ...);
+int hal_pin_u32_newf(hal_pin_dir_t dir, hal_u32_t **data_ptr_addr, int comp_id, const char *fmt, ...);
+int hal_param_float_newf(hal_param_dir_t dir, hal_float_t *data_addr, int comp_id, const char *fmt, ...);
+
+int hal_export_funct(const char *name, void (*funct)(void *, long), void *arg, int uses_fp, int reentrant, int comp_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
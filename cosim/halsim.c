@@ -0,0 +1,165 @@
+#include "halsim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define HALSIM_OBJECTS		512
+#define HALSIM_FUNCTS		16
+
+
+typedef struct
+{
+	char	name[HAL_NAME_LEN + 1];
+	void	*data;
+} halsim_object_t;
+
+typedef struct
+{
+	char	name[HAL_NAME_LEN + 1];
+	void	(*funct)(void *, long);
+	void	*arg;
+} halsim_funct_t;
+
+
+int halsim_verbose = 0;
+
+static halsim_object_t	objects[HALSIM_OBJECTS];
+static int				numObjects = 0;
+static halsim_funct_t	functs[HALSIM_FUNCTS];
+static int				numFuncts = 0;
+
+
+static int add_object(void *data, const char *fmt, va_list args)
+{
+	if (numObjects >= HALSIM_OBJECTS) return -ENOMEM;
+
+	vsnprintf(objects[numObjects].name, sizeof(objects[numObjects].name), fmt, args);
+	objects[numObjects].data = data;
+	numObjects++;
+	return 0;
+}
+
+
+// pins are allocated here, as hal_malloc'd memory would be in HAL shared memory
+#define HALSIM_PIN_NEWF(function, type)												\
+int function(hal_pin_dir_t dir, type **data_ptr_addr, int comp_id, const char *fmt, ...)	\
+{																					\
+	va_list args;																	\
+	int retval;																		\
+																					\
+	*data_ptr_addr = (type *)calloc(1, sizeof(type));								\
+	if (*data_ptr_addr == NULL) return -ENOMEM;										\
+																					\
+	va_start(args, fmt);															\
+	retval = add_object((void *)*data_ptr_addr, fmt, args);							\
+	va_end(args);																	\
+	return retval;																	\
+}
+
+HALSIM_PIN_NEWF(hal_pin_bit_newf, hal_bit_t)
+HALSIM_PIN_NEWF(hal_pin_float_newf, hal_float_t)
+HALSIM_PIN_NEWF(hal_pin_s32_newf, hal_s32_t)
+HALSIM_PIN_NEWF(hal_pin_u32_newf, hal_u32_t)
+
+
+int hal_param_float_newf(hal_param_dir_t dir, hal_float_t *data_addr, int comp_id, const char *fmt, ...)
+{
+	va_list args;
+	int retval;
+
+	va_start(args, fmt);
+	retval = add_object((void *)data_addr, fmt, args);
+	va_end(args);
+	return retval;
+}
+
+
+int hal_export_funct(const char *name, void (*funct)(void *, long), void *arg, int uses_fp, int reentrant, int comp_id)
+{
+	if (numFuncts >= HALSIM_FUNCTS) return -ENOMEM;
+
+	snprintf(functs[numFuncts].name, sizeof(functs[numFuncts].name), "%s", name);
+	functs[numFuncts].funct = funct;
+	functs[numFuncts].arg = arg;
+	numFuncts++;
+	return 0;
+}
+
+
+int hal_init(const char *name)		{ return 1; }
+int hal_exit(int comp_id)			{ return 0; }
+int hal_ready(int comp_id)			{ return 0; }
+void *hal_malloc(long size)			{ return calloc(1, size); }
+
+
+void *halsim_pin(const char *name)
+{
+	int i;
+
+	for (i = 0; i < numObjects; i++)
+	{
+		if (!strcmp(objects[i].name, name)) return objects[i].data;
+	}
+
+	return NULL;
+}
+
+
+int halsim_call(const char *name, long period)
+{
+	int i;
+
+	for (i = 0; i < numFuncts; i++)
+	{
+		if (!strcmp(functs[i].name, name))
+		{
+			functs[i].funct(functs[i].arg, period);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+
+void rtapi_print(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+}
+
+
+void rtapi_print_msg(int level, const char *fmt, ...)
+{
+	va_list args;
+
+	if (level >= RTAPI_MSG_INFO && !halsim_verbose) return;
+
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+}
+
+
+int rtapi_snprintf(char *buf, unsigned long size, const char *fmt, ...)
+{
+	va_list args;
+	int retval;
+
+	va_start(args, fmt);
+	retval = vsnprintf(buf, size, fmt, args);
+	va_end(args);
+	return retval;
+}
+
+
+int rtapi_open_as_root(const char *name, int mode)
+{
+	// the bcm2835 transport is not used in the co-simulation
+	return -1;
+}
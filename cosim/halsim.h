@@ -0,0 +1,25 @@
+#ifndef HALSIM_H
+#define HALSIM_H
+
+// A minimal HAL for running the remora component outside LinuxCNC
+//
+// hal.h, rtapi.h and rtapi_app.h stand in for the LinuxCNC headers when remora.c is compiled
+// for the co-simulation. Pins and parameters are kept by name, and the exported functions are
+// called by name, in the order a HAL thread would call them.
+
+#include "hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int halsim_verbose;								// print RTAPI_MSG_INFO messages
+
+void *halsim_pin(const char *name);						// pin or parameter storage, NULL if not exported
+int halsim_call(const char *name, long period);			// run an exported function, -1 if not exported
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef RTAPI_H
+#define RTAPI_H
+
+// Stand-in for the LinuxCNC RTAPI header, only what remora.c uses. See halsim.h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTAPI_MSG_NONE		0
+#define RTAPI_MSG_ERR		1
+#define RTAPI_MSG_WARN		2
+#define RTAPI_MSG_INFO		3
+#define RTAPI_MSG_DBG		4
+
+void rtapi_print(const char *fmt, ...);
+void rtapi_print_msg(int level, const char *fmt, ...);
+int rtapi_snprintf(char *buf, unsigned long size, const char *fmt, ...);
+int rtapi_open_as_root(const char *name, int mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
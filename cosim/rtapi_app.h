@@ -0,0 +1,15 @@
+#ifndef RTAPI_APP_H
+#define RTAPI_APP_H
+
+// Stand-in for the LinuxCNC RTAPI module header. Module parameters are plain globals that the
+// harness sets before calling rtapi_app_main()
+
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+
+#define RTAPI_MP_INT(var, desc)
+#define RTAPI_MP_STRING(var, desc)
+#define RTAPI_MP_ARRAY_STRING(var, num, desc)
+
+#endif